@@ -66,7 +66,7 @@ end
 
 function Entity:detach()
     if self.lastPlatform then
-        table.delete(self.lastPlatform.contacts, self)
+        self.lastPlatform.contacts:remove(self)
         self.lastPlatform = nil
     end
 end
@@ -134,7 +134,7 @@ function Entity:update(dt)
                     self:detach()
                 end
                 self.lastPlatform = self.contactSurface.down
-                table.insert(self.lastPlatform.contacts, self)
+                self.lastPlatform.contacts:add(self)
                 self.gravity = self.lastPlatform.vel.y
             end
 
@@ -22,8 +22,8 @@ require 'Entity'
 Player = class('Player', Entity)
 function Player:new(x, y, w, h)
 
-    image.load('player.png')
-    image.setTiles('player.png', 8, 8)
+    self.image = image.load('player.png')
+    image.setTiles(self.image, 8, 8)
 
     Entity.new(self, x, y, w, h)
 
@@ -303,7 +303,7 @@ end
 function Player:draw(debug)
 
     local frame = self.animation:getFrame()
-    image.drawTile('player.png', math.round(self.pos.x - 3), 
+    image.drawTile(self.image, math.round(self.pos.x - 3), 
                                  math.round(self.pos.y - 4), 
                                  frame, self.drawDirection == 1)
     if debug then
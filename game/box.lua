@@ -133,18 +133,18 @@ function StaticBoxGrid:new(spacing)
     self.buckets = {}
     self.empty = {}
 
-    self.boxes = {}
+    self.boxes = set.new()
 end
 
 function StaticBoxGrid:add(box)
 
-    table.insert(self.boxes, box)
+    self.boxes:add(box)
     self:eachIn(box.min.x, box.min.y, box.max.x, box.max.y, function(x, y, hash)
     
         if not self.buckets[hash] then
-            self.buckets[hash] = {}
+            self.buckets[hash] = set.new()
         end
-        table.insert(self.buckets[hash], box)
+        self.buckets[hash]:add(box)
 
     end)
 
@@ -152,13 +152,12 @@ end
 
 function StaticBoxGrid:remove(box)
 
-    table.delete(self.boxes, box)
+    self.boxes:remove(box)
     self:eachIn(box.min.x, box.min.y, box.max.x, box.max.y, function(x, y, hash)
     
-        if not self.buckets[hash] then
-            self.buckets[hash] = {}
+        if self.buckets[hash] then
+            self.buckets[hash]:remove(box)
         end
-        table.delete(self.buckets[hash], box)
 
     end)
 
@@ -185,8 +184,10 @@ function StaticBoxGrid:hash(x, y)
     return math.floor(x / self.spacing) * (self.spacing * 8) + math.floor(y / self.spacing)
 end
 
+-- returns the bucket's item array, it must not be modified
 function StaticBoxGrid:get(x, y)
-    return self.buckets[self:hash(x, y)] or self.empty
+    local bucket = self.buckets[self:hash(x, y)]
+    return bucket and bucket:items() or self.empty
 end
 -- End StaticBoxGrid ----------------------------------------------------------------
 
@@ -387,10 +388,18 @@ function DynamicBox:onCollision(other, vel, normal)
 
 end
 
+-- Scratch vectors which never leave a single sweep, the velocity and
+-- normal it returns are only valid until the next call
+local sweepVel = vec2.new()
+local sweepOverlaps = vec2.new()
+local sweepPush = vec2.new()
+local sweepOut = vec2.new()
+local sweepNormal = vec2.new()
+
 function DynamicBox:sweep(other, otherVel)
     local a = self
     local b = other
-    local v = { x = a.vel.x - b.vel.x, y = a.vel.y - b.vel.y }
+    local v = sweepVel:set(a.vel.x - b.vel.x, a.vel.y - b.vel.y)
 
     if otherVel then
         v.x = v.x + otherVel.x
@@ -399,12 +408,7 @@ function DynamicBox:sweep(other, otherVel)
 
     local hitTime = 0
     local outTime = 1
-    local overlapsTime = {
-        x = 0,
-        y = 0
-    }
-
-    local outVel = { x = 0, y = 0 }
+    local overlapsTime = sweepOverlaps:set(0, 0)
 
     -- invert v, since we're treating b as stationary here
     v.x = -v.x
@@ -465,8 +469,7 @@ function DynamicBox:sweep(other, otherVel)
     if hitTime > outTime then return false, nil, nil end
 
     -- the correction to the current velocity
-    outVel.x = (v.x - (v.x * hitTime))
-    outVel.y = (v.y - (v.y * hitTime))
+    local outVel = sweepOut:set(v.x - (v.x * hitTime), v.y - (v.y * hitTime))
 
     -- IMPORTANT
     -- since hitTime defaults to 0, everything that's
@@ -486,10 +489,10 @@ function DynamicBox:sweep(other, otherVel)
         outVel.y = 0
     end
 
-    local hitNormal = {
-        x = (outVel.x < 0) and 1 or ((outVel.x > 0) and -1 or 0),
-        y = (outVel.y < 0) and 1 or ((outVel.y > 0) and -1 or 0)
-    }
+    local hitNormal = sweepNormal:set(
+        (outVel.x < 0) and 1 or ((outVel.x > 0) and -1 or 0),
+        (outVel.y < 0) and 1 or ((outVel.y > 0) and -1 or 0)
+    )
 
     -- allow us to get away if we're in contact but are moving into the opposite
     -- direction
@@ -584,10 +587,7 @@ function DynamicBox:sweep(other, otherVel)
         end
 
         -- in case we're stuck make sure push us out
-        local pushVel = {
-            x = 0,
-            y = 0
-        }
+        local pushVel = sweepPush:set(0, 0)
 
         local acy = a.min.y + a.size.y / 2
         local bcy = b.min.y + b.size.y / 2
@@ -744,17 +744,17 @@ end
 local BoxManager = class('BoxManager')
 
 function BoxManager:new()
-    self.dynamics = {}
-    self.movings = {}
+    self.dynamics = set.new()
+    self.movings = set.new()
     self.staticGrid = StaticBoxGrid(64)
 end
 
 function BoxManager:add(box)
     if box:is_a(DynamicBox) then
-        table.insert(self.dynamics, box)
+        self.dynamics:add(box)
 
     elseif box:is_a(MovingBox) then
-        table.insert(self.movings, box)
+        self.movings:add(box)
 
     else
         self.staticGrid:add(box)
@@ -763,43 +763,21 @@ end
 
 function BoxManager:remove(box)
     if box:is_a(DynamicBox) then
-        table.delete(self.dynamics, box)
+        self.dynamics:remove(box)
 
     elseif box:is_a(MovingBox) then
-        table.delete(self.movings, box)
+        self.movings:remove(box)
 
     else
         self.staticGrid:remove(box)
     end
 end
 
-table.delete = function(t, item)
-
-    local index = table.find(t, item)
-    if index > 0 then
-        table.remove(t, index)
-        return true
-
-    else
-        return false
-    end
-
-end
-
-table.find = function(t, item)
-
-    for i=1, #t do
-        if t[i] == item then
-            return i
-        end
-    end
-
-    return 0
-
-end
-
 function BoxManager:update(dt)
 
+    local dynamics = self.dynamics:items()
+    local movings = self.movings:items()
+
     --table.sort(self.dynamics, function(a, b)
         --if a.pos.y > b.pos.y then
             --return true
@@ -809,14 +787,14 @@ function BoxManager:update(dt)
         --end
     --end)
 
-    for i=1, #self.dynamics do
-        self.dynamics[i]:beforeUpdate(dt)
+    for i=1, #dynamics do
+        dynamics[i]:beforeUpdate(dt)
     end
 
     -- collide all dynamics against all statics
-    for i=1, #self.dynamics do
+    for i=1, #dynamics do
 
-        local box = self.dynamics[i]
+        local box = dynamics[i]
 
         -- now check all static dynamics in the same area
         local statics = self.staticGrid:get(box.pos.x, box.pos.y)
@@ -832,17 +810,17 @@ function BoxManager:update(dt)
 
     end
 
-    for i=1, #self.dynamics do
+    for i=1, #dynamics do
 
-        local box = self.dynamics[i]
+        local box = dynamics[i]
 
         -- now check all static dynamics in the same area
-        for e=1, #self.movings do
+        for e=1, #movings do
 
-            local col, vel, normal = box:sweep(self.movings[e])
+            local col, vel, normal = box:sweep(movings[e])
 
             if col then
-                box:onCollision(self.movings[e], vel, normal)
+                box:onCollision(movings[e], vel, normal)
             end
 
         end
@@ -850,8 +828,8 @@ function BoxManager:update(dt)
     end
 
     -- now update all dynamic and movings boxes 
-    for i=1, #self.dynamics do
-        self.dynamics[i]:update(dt)
+    for i=1, #dynamics do
+        dynamics[i]:update(dt)
     end
 
     -- collide all dynamics with each other
@@ -870,15 +848,16 @@ function BoxManager:update(dt)
     --end
     
 
-    for i=1, #self.movings do
-        self.movings[i]:update(dt)
+    for i=1, #movings do
+        movings[i]:update(dt)
     end
 end
 
 function BoxManager:collideBox(box, ignore)
-    for e=1, #self.dynamics do
+    local dynamics = self.dynamics:items()
+    for e=1, #dynamics do
 
-        local other = self.dynamics[e]
+        local other = dynamics[e]
         if other ~= box then
 
             local col, vel, normal = box:sweep(other)
@@ -902,6 +881,8 @@ end
 function BoxManager:eachIn(x, y, mx, my, callback)
     
     local filtered = {}
+    local dynamics = self.dynamics:items()
+    local movings = self.movings:items()
 
     self.staticGrid:eachIn(x, y, mx, my, function(x, y, hash, statics)
         for e=1, #statics do
@@ -915,9 +896,9 @@ function BoxManager:eachIn(x, y, mx, my, callback)
         end
     end)
 
-    for i=1, #self.movings do
-        if self.movings[i]:within(x, y, mx, my) then
-            local box = self.movings[i]
+    for i=1, #movings do
+        if movings[i]:within(x, y, mx, my) then
+            local box = movings[i]
             if not filtered[box.id] then
                 if callback(box) then
                     return true
@@ -927,9 +908,9 @@ function BoxManager:eachIn(x, y, mx, my, callback)
         end
     end
 
-    for i=1, #self.dynamics do
-        if self.dynamics[i]:within(x, y, mx, my) then
-            local box = self.dynamics[i]
+    for i=1, #dynamics do
+        if dynamics[i]:within(x, y, mx, my) then
+            local box = dynamics[i]
             if not filtered[box.id] then
                 if callback(box) then
                     return true
@@ -1,7 +1,11 @@
 __class_cache = __class_cache or {}
+__class_count = __class_count or 0
 
 -- class.lua
 -- Compatible with Lua 5.1 (not 5.0).
+local band = bit32 and bit32.band
+local lshift = bit32 and bit32.lshift
+
 function class(id, base)
 
     if __class_cache[id] then
@@ -23,6 +27,25 @@ function class(id, base)
     -- and they will look up their methods in it.
     c.__index = c
 
+    -- every class gets a type id, the first 32 also get a bit so is_a is a
+    -- single test against the mask of the class and all its bases
+    c._typeid = __class_count
+    c._types = { [c] = true }
+    c._typebit = nil
+    c._typemask = base and base._typemask or 0
+
+    if base and base._types then
+        for k, _ in pairs(base._types) do
+            c._types[k] = true
+        end
+    end
+
+    if lshift and c._typeid < 32 then
+        c._typebit = lshift(1, c._typeid)
+        c._typemask = c._typemask + c._typebit
+    end
+    __class_count = __class_count + 1
+
     -- expose a constructor which can be called by <classname>(<args>)
     local mt = {}
     mt.__call = function(class_tbl, ...)
@@ -48,17 +71,16 @@ function class(id, base)
     c.is_a = function(self, klass)
 
         local m = getmetatable(self)
-        while m do 
+        if not m or not m._types or not klass then
+            return false
 
-            if m == klass then 
-                return true 
-            end
+        elseif klass._typebit then
+            return band(m._typemask, klass._typebit) ~= 0
 
-            m = m._base
+        else
+            return m._types[klass] == true
         end
 
-        return false
-
     end
 
     setmetatable(c, mt)
@@ -67,3 +89,36 @@ function class(id, base)
     return c
 
 end
+
+-- type information belongs to each class itself
+local typeFields = { _typeid = true, _types = true, _typebit = true, _typemask = true }
+
+-- copies everything a base class got after its subclasses were created
+-- into the subclasses, so that every method is found in the object's own
+-- class table; call it once all classes are defined
+local function finalize(c, done)
+
+    if done[c] then
+        return
+    end
+    done[c] = true
+
+    local base = c._base
+    if base then
+        finalize(base, done)
+        for i,v in pairs(base) do
+            if c[i] == nil and not typeFields[i] then
+                c[i] = v
+            end
+        end
+    end
+
+end
+
+function class_finalize()
+    local done = {}
+    for id, c in pairs(__class_cache) do
+        finalize(c, done)
+    end
+end
+
@@ -72,7 +72,7 @@ function Platform:new(x, y, w, h, points)
     self.blocks.right = false
     self.blocks.left = false
 
-    self.contacts = {}
+    self.contacts = set.new()
     self.waypoints = points or { { x, y } }
     self.direction = 1
     self.toDirection = self.direction
@@ -129,9 +129,10 @@ function Platform:update(dt)
         end
     end
 
-    for i=1,#self.contacts do
+    local contacts = self.contacts:items()
+    for i=1,#contacts do
 
-        local c = self.contacts[i]
+        local c = contacts[i]
         c.vel.y = vy
 
         if c.vel.x == 0 or (c.vel.x > 0 and vx > 0) or (c.vel.x < 0 and vx < 0) then
@@ -158,6 +159,9 @@ function Platform:draw(debug)
 
 end
 
+-- all classes are defined now
+class_finalize()
+
 
 function game.init(conf)
     conf.title = "Kuusi"
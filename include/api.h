@@ -35,6 +35,27 @@
 #include "game.h"
 #include "debug.h"
 
+// A loaded image along with how it's split up into tiles
+typedef struct Image {
+    ALLEGRO_BITMAP *bitmap;
+    int cols;
+    int rows;
+
+} Image;
+
+#define IMAGE_TYPE "image"
+#define SOUND_TYPE "sound"
+
+// What Lua holds on to for a loaded image or sound, each kind has its own
+// metatable so one can't be passed in for the other, the resources
+// themselves stay owned by their caches. The name lets the serializer
+// write the handle out and load it again later
+typedef struct Handle {
+    void *resource;
+    char name[];
+
+} Handle;
+
 void apiInit();
 
 #endif
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef DATA_H
+#define DATA_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "../deps/lua/lua.h"
+#include "../deps/lua/lauxlib.h"
+#include "vec.h"
+#include "set.h"
+
+#ifndef THREAD_LOCAL
+#define THREAD_LOCAL __thread
+#endif
+
+#define DATA_VERSION 1
+#define DATA_MAX_DEPTH 200
+
+typedef enum DataTag {
+    DATA_NIL = 0,
+    DATA_FALSE,
+    DATA_TRUE,
+    DATA_INTEGER,
+    DATA_NUMBER,
+    DATA_STRING,
+    DATA_TABLE,
+    DATA_INSTANCE,
+    DATA_CLASS,
+    DATA_REF,
+    DATA_VEC2,
+    DATA_AABB,
+    DATA_RESOURCE,
+    DATA_SET
+
+} DataTag;
+
+void dataInit(lua_State *L);
+const char *dataSerialize(lua_State *L, int index, size_t *len);
+void dataDeserialize(lua_State *L, const char *buf, size_t len);
+
+#endif
+
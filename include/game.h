@@ -22,7 +22,14 @@
 #ifndef GAME_H
 #define GAME_H
 
+// Everything that belongs to a single game instance is thread local, so that
+// several instances can be simulated side by side
+#ifndef THREAD_LOCAL
+#define THREAD_LOCAL __thread
+#endif
+
 #include <stdio.h>
+#include <stdint.h>
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_image.h>
 #include <allegro5/allegro_acodec.h>
@@ -31,11 +38,20 @@
 #include "io.h"
 #include "lua.h"
 #include "api.h"
+#include "stats.h"
+#include "render.h"
+#include "replay.h"
+#include "sched.h"
+#include "watch.h"
 #include "debug.h"
 
+#define NS_PER_SECOND 1000000000ULL
+
 void gameExit(const char *msg);
+void gameInitSystem();
 void gameLoad();
 void gameLoop();
+void gameLoopHeadless(unsigned int ticks);
 void gameAPI();
 void gameCleanup();
 
@@ -48,53 +64,63 @@ extern const int defaultWidth;
 extern const int defaultHeight;
 extern const int defaultScale;
 extern const int defaultFrameRate;
+extern const int defaultKeepAlive;
 
 // State and Time
-extern bool stateIsRunning;
-extern bool stateIsPaused;
-extern bool stateHasKeyboard;
-extern bool stateHasMouse;
-
-extern bool stateReload;
-
-extern double gameTime;
-extern double gameTimeDelta;
+extern THREAD_LOCAL int gameInstance;
+extern THREAD_LOCAL bool stateIsRunning;
+extern THREAD_LOCAL bool stateIsPaused;
+extern THREAD_LOCAL bool stateHasKeyboard;
+extern THREAD_LOCAL bool stateHasMouse;
+
+extern THREAD_LOCAL bool stateReload;
+extern bool stateIsHeadless;
+
+extern THREAD_LOCAL uint64_t gameTick;
+extern THREAD_LOCAL uint64_t gameTimeNs;
+extern THREAD_LOCAL double gameTime;
+extern THREAD_LOCAL double gameTimeDelta;
+extern THREAD_LOCAL double gameTimeAlpha;
 extern ALLEGRO_EVENT_QUEUE *stateEventQueue;
 extern ALLEGRO_TIMER *stateTimer;
 
 // Input
-extern int mouseX;
-extern int mouseY;
-extern int mouseCount;
-extern int mouseStates[];
-extern int mouseStatesOld[];
+#define MAX_MOUSE 8
+
+extern THREAD_LOCAL int mouseX;
+extern THREAD_LOCAL int mouseY;
+extern THREAD_LOCAL int mouseCount;
+extern THREAD_LOCAL int mouseStates[];
+extern THREAD_LOCAL int mouseStatesOld[];
 
-extern int keyCount;
-extern int keyStates[];
-extern int keyStatesOld[];
+extern THREAD_LOCAL int keyCount;
+extern THREAD_LOCAL int keyStates[];
+extern THREAD_LOCAL int keyStatesOld[];
 
 // Graphics
-extern const char* graphicsTitle;
-extern int graphicsWidth;
-extern int graphicsHeight;
-extern int graphicsScale;
-extern bool graphicsResized;
-extern int graphicsFrameRate;
-extern int graphicsLineWidth;
-extern ALLEGRO_COLOR graphicsColor;
-extern ALLEGRO_COLOR graphicsBackgroundColor;
+extern THREAD_LOCAL const char* graphicsTitle;
+extern THREAD_LOCAL int graphicsWidth;
+extern THREAD_LOCAL int graphicsHeight;
+extern THREAD_LOCAL int graphicsScale;
+extern THREAD_LOCAL bool graphicsResized;
+extern bool graphicsThreaded;
+extern THREAD_LOCAL bool graphicsDirty;
+extern THREAD_LOCAL int graphicsKeepAlive;
+extern THREAD_LOCAL int graphicsFrameRate;
+extern THREAD_LOCAL int graphicsLineWidth;
+extern THREAD_LOCAL ALLEGRO_COLOR graphicsColor;
+extern THREAD_LOCAL ALLEGRO_COLOR graphicsBackgroundColor;
 extern ALLEGRO_DISPLAY *graphicsDisplay;
 extern ALLEGRO_BITMAP *graphicsBackground;
 
-extern int graphicsRenderOffsetX;
-extern int graphicsRenderOffsetY;
+extern THREAD_LOCAL int graphicsRenderOffsetX;
+extern THREAD_LOCAL int graphicsRenderOffsetY;
 
 // Images
-extern HashMap *graphicsImages;
-extern HashMap *graphicsImageTiles;
+extern THREAD_LOCAL HashMap *graphicsImages;
 
 // Sounds
-extern HashMap *soundSamples;
+extern THREAD_LOCAL HashMap *soundSamples;
 
 #endif
 
@@ -26,6 +26,7 @@
 #include <allegro5/allegro_memfile.h>
 #include <allegro5/allegro_audio.h>
 #include "../deps/minizip/unzip.h"
+#include "trace.h"
 #include "debug.h"
 
 void ioOpenBundle(const char *filename);
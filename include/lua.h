@@ -28,18 +28,35 @@
 #include "../deps/lua/lauxlib.h"
 
 #include "io.h"
+#include "pool.h"
+#include "vec.h"
+#include "set.h"
+#include "data.h"
+#include "worker.h"
 #include "game.h"
+#include "trace.h"
 #include "debug.h"
 
-lua_State *L;
+extern THREAD_LOCAL lua_State *L;
+extern THREAD_LOCAL Pool luaPool;
 
+lua_State *luaNewState();
 void luaInit();
 void luaLoad();
 void luaUpdate();
 void luaRender();
 void luaError();
 void luaCleanup();
-void luaRequire(const char *filename);
+bool luaRequire(const char *filename);
+void luaClearModules();
+void luaReloadModule(const char *name);
+bool luaCompile(const char *source, const char *target);
+void luaSetBudget(double seconds, bool abort);
+void luaHookThread(lua_State *co);
+void luaSetGCBudget(double seconds);
+void luaCollect(double available);
+void luaProfileStart();
+bool luaProfileStop(const char *filename);
 
 bool luax_optboolean(lua_State * L, int idx, bool b);
 
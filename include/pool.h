@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+
+// Small blocks are served from size classes in steps of POOL_GRANULARITY,
+// anything bigger goes straight to the system allocator
+#define POOL_GRANULARITY 16
+#define POOL_CLASSES 16
+#define POOL_MAX_SIZE (POOL_GRANULARITY * POOL_CLASSES)
+#define POOL_SLAB_SIZE 65536
+
+typedef struct PoolBlock {
+    struct PoolBlock *next;
+
+} PoolBlock;
+
+typedef struct PoolSlab {
+    struct PoolSlab *next;
+
+} PoolSlab;
+
+typedef struct PoolStats {
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long bytes;
+    unsigned long classAllocs[POOL_CLASSES + 1];
+
+} PoolStats;
+
+typedef struct Pool {
+    PoolBlock *free[POOL_CLASSES];
+    PoolSlab *slabs;
+    char *slabPos;
+    size_t slabLeft;
+
+    size_t used;
+    size_t reserved;
+
+    // Counters of the running frame and the one before
+    PoolStats frame;
+    PoolStats last;
+
+} Pool;
+
+void *poolAlloc(void *ud, void *ptr, size_t osize, size_t nsize);
+void poolNextFrame(Pool *pool);
+void poolDestroy(Pool *pool);
+
+#endif
+
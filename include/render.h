@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+#include "game.h"
+#include "trace.h"
+#include "debug.h"
+
+typedef enum RenderType {
+    RENDER_LINE = 0,
+    RENDER_TRIANGLE,
+    RENDER_RECT,
+    RENDER_CIRCLE,
+    RENDER_BITMAP
+
+} RenderType;
+
+// A single recorded draw call, coordinates are final screen coordinates
+typedef struct RenderCommand {
+    unsigned char type;
+    unsigned char filled;
+    unsigned char tinted;
+    unsigned char flags;
+    float thickness;
+    ALLEGRO_COLOR color;
+    ALLEGRO_BITMAP *bitmap;
+    float v[6];
+
+} RenderCommand;
+
+// All draw calls of a frame together with the display state they need
+typedef struct RenderBuffer {
+    RenderCommand *commands;
+    unsigned int length;
+    unsigned int size;
+
+    ALLEGRO_COLOR background;
+    int width;
+    int height;
+    int scale;
+
+    // Filled in while drawing, since the stats are kept per thread
+    double blitTime;
+    double flipTime;
+
+} RenderBuffer;
+
+void renderInit(bool threaded);
+void renderBegin();
+void renderEnd();
+void renderAcquire();
+void renderRelease();
+void renderCleanup();
+
+void renderLine(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color, float thickness);
+void renderTriangle(float x1, float y1, float x2, float y2, float x3, float y3, 
+                    ALLEGRO_COLOR color, float thickness, bool filled);
+
+void renderRect(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color, float thickness, bool filled);
+void renderCircle(float x, float y, float r, ALLEGRO_COLOR color, float thickness, bool filled);
+void renderBitmap(ALLEGRO_BITMAP *bitmap, float sx, float sy, float sw, float sh, 
+                  float dx, float dy, ALLEGRO_COLOR tint, int flags);
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdlib.h>
+#include "lua.h"
+#include "game.h"
+#include "debug.h"
+
+// Number of slots in the timer wheel, tasks further in the future simply
+// stay in their slot for more rounds
+#define SCHED_SLOTS 256
+
+typedef struct SchedTask {
+    int ref;
+    unsigned long due;
+    struct SchedTask *next;
+
+} SchedTask;
+
+void schedSpawn(lua_State *L, int index);
+int schedWait(lua_State *L, unsigned long ticks);
+void schedStep();
+void schedCleanup();
+
+#endif
+
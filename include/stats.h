@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <allegro5/allegro.h>
+#include "render.h"
+#include "debug.h"
+
+typedef enum StatsPhase {
+    STATS_EVENTS = 0,
+    STATS_UPDATE,
+    STATS_RENDER,
+    STATS_BLIT,
+    STATS_FLIP,
+    STATS_GC,
+    STATS_FRAME,
+    STATS_COUNT
+
+} StatsPhase;
+
+void statsBegin(StatsPhase phase);
+void statsEnd(StatsPhase phase);
+void statsAdd(StatsPhase phase, double seconds);
+void statsNextFrame();
+void statsOverrun();
+unsigned int statsGetOverruns();
+void statsGet(StatsPhase phase, double *min, double *avg, double *p99);
+const char *statsGetName(StatsPhase phase);
+void statsRender(int x, int y, double budget);
+
+
+// Externals ------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+extern THREAD_LOCAL bool statsOverlay;
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <allegro5/allegro.h>
+#include "debug.h"
+
+#ifndef THREAD_LOCAL
+#define THREAD_LOCAL __thread
+#endif
+
+#define TRACE_CHUNK_SIZE 4096
+
+// A single begin or end of a zone, names must be string literals
+typedef struct TraceEvent {
+    const char *name;
+    char phase;
+    double time;
+
+} TraceEvent;
+
+// Events are kept in fixed size chunks so they never move while another
+// thread writes them out
+typedef struct TraceChunk {
+    TraceEvent events[TRACE_CHUNK_SIZE];
+    unsigned int length;
+    struct TraceChunk *next;
+
+} TraceChunk;
+
+// Every thread records into its own buffer
+typedef struct TraceBuffer {
+    int id;
+    TraceChunk *first;
+    TraceChunk *last;
+    struct TraceBuffer *next;
+
+} TraceBuffer;
+
+void traceStart(const char *filename);
+void traceBegin(const char *name);
+void traceEnd(const char *name);
+bool traceDump(const char *filename);
+void traceCleanup();
+
+
+// Externals ------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+extern bool traceEnabled;
+
+#endif
+
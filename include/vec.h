@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef VEC_H
+#define VEC_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../deps/lua/lua.h"
+#include "../deps/lua/lauxlib.h"
+
+#define VEC2_TYPE "vec2"
+#define AABB_TYPE "aabb"
+
+typedef struct Vec2 {
+    lua_Number x;
+    lua_Number y;
+
+} Vec2;
+
+// Stored as position and size, min and max are derived
+typedef struct AABB {
+    lua_Number x;
+    lua_Number y;
+    lua_Number w;
+    lua_Number h;
+
+} AABB;
+
+void vecInit(lua_State *L);
+Vec2 *vecPush(lua_State *L, lua_Number x, lua_Number y);
+AABB *aabbPush(lua_State *L, lua_Number x, lua_Number y, lua_Number w, lua_Number h);
+
+#endif
+
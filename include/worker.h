@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdbool.h>
+#include <allegro5/allegro.h>
+#include "../deps/lua/lua.h"
+#include "../deps/lua/lauxlib.h"
+#include "lua.h"
+#include "debug.h"
+
+#define WORKER_TYPE "worker"
+
+// Messages are values in the serializer format, copied into a single block
+typedef struct WorkerMessage {
+    struct WorkerMessage *next;
+    size_t length;
+    char data[];
+
+} WorkerMessage;
+
+typedef struct WorkerChannel {
+    ALLEGRO_MUTEX *mutex;
+    ALLEGRO_COND *cond;
+    WorkerMessage *first;
+    WorkerMessage *last;
+    bool closed;
+
+} WorkerChannel;
+
+typedef struct Worker {
+    char *module;
+    int instance;
+    ALLEGRO_THREAD *thread;
+    lua_State *state;
+    WorkerChannel inbox;
+    WorkerChannel outbox;
+
+} Worker;
+
+void workerInit(lua_State *L);
+
+#endif
+
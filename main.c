@@ -19,14 +19,71 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <string.h>
+#include <stdlib.h>
 #include <allegro5/allegro.h>
 #include "include/io.h"
 #include "include/game.h"
 #include "include/lua.h"
+#include "include/runner.h"
+#include "include/trace.h"
 #include "include/debug.h"
 
 int main(int argc, char *argv[]) {
 
+    int i;
+    unsigned int headlessTicks = 0;
+    unsigned int instances = 1;
+    const char *recordFile = NULL;
+    const char *replayFile = NULL;
+    const char *traceFile = NULL;
+
+    // Compile a module to bytecode, this is part of building the bundle
+    if (argc == 4 && strcmp(argv[1], "--compile") == 0) {
+        return luaCompile(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    // Parse command line options
+    for(i = 1; i < argc; i++) {
+
+        // Simulate a number of ticks without display, input or audio
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            stateIsHeadless = true;
+            headlessTicks = atoi(argv[++i]);
+
+        // Run several headless instances in parallel
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instances = atoi(argv[++i]);
+            if (instances < 1 || instances > MAX_INSTANCES) {
+                debugLog("main: --instances must be between 1 and %d\n", MAX_INSTANCES);
+                return 1;
+            }
+
+        // Record engine zones into a trace event file
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceFile = argv[++i];
+
+        // Record the input of this session
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordFile = argv[++i];
+
+        // Play back a recorded session instead of taking input
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayFile = argv[++i];
+        }
+
+    }
+
+    // Allegro has to be set up before the bundle's mutex or any thread is
+    // created
+    gameInitSystem();
+
+    // Trace timestamps are relative to Allegro's clock, so this has to wait
+    // for the system as well
+    if (traceFile != NULL) {
+        traceStart(traceFile);
+    }
+
     // Open the bundle this will trigger all game data to be loaded from the
     // zip file that's attached to the binary
     #ifdef BUNDLE
@@ -37,11 +94,36 @@ int main(int argc, char *argv[]) {
 
     debugLog("main: enter...\n");
 
+    // Every instance loads and cleans up on its own
+    if (stateIsHeadless && instances > 1) {
+        runnerRun(instances, headlessTicks);
+        ioCloseBundle();
+        traceCleanup();
+        debugLog("main: leave...\n");
+        return 0;
+    }
+
     luaInit();
     gameLoad();
-    gameLoop();
+
+    if (replayFile != NULL && !replayPlay(replayFile)) {
+        gameExit("Failed to open replay.");
+
+    } else if (recordFile != NULL && !replayRecord(recordFile)) {
+        gameExit("Failed to open replay for recording.");
+    }
+
+    if (stateIsHeadless) {
+        gameLoopHeadless(headlessTicks);
+
+    } else {
+        gameLoop();
+    }
+
     gameCleanup();
     luaCleanup();
+    ioCloseBundle();
+    traceCleanup();
 
     debugLog("main: leave...\n");
 
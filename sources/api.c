@@ -36,26 +36,182 @@ static int gameGetTime(lua_State *L)  {
     return 1;
 }
 
+// Number of fixed steps the game has advanced, pausing stops it
+static int gameGetTick(lua_State *L)  {
+    lua_pushnumber(L, (lua_Number)gameTick);
+    return 1;
+}
+
+static int gameGetTimeNs(lua_State *L)  {
+    lua_pushnumber(L, (lua_Number)gameTimeNs);
+    return 1;
+}
+
 static int gameGetDelta(lua_State *L)  {
     lua_pushnumber(L, gameTimeDelta);
     return 1;
 }
 
+static int gameGetAlpha(lua_State *L)  {
+    lua_pushnumber(L, gameTimeAlpha);
+    return 1;
+}
+
+// Returns a table with min / avg / p99 times in milliseconds for each phase
+// of the last frames
+static int gameGetFrameStats(lua_State *L)  {
+
+    unsigned int i;
+    double min, avg, p99;
+
+    lua_newtable(L);
+    for(i = 0; i < STATS_COUNT; i++) {
+
+        statsGet(i, &min, &avg, &p99);
+
+        lua_newtable(L);
+        lua_pushnumber(L, min);
+        lua_setfield(L, -2, "min");
+        lua_pushnumber(L, avg);
+        lua_setfield(L, -2, "avg");
+        lua_pushnumber(L, p99);
+        lua_setfield(L, -2, "p99");
+        lua_setfield(L, -2, statsGetName(i));
+
+    }
+
+    lua_pushinteger(L, statsGetOverruns());
+    lua_setfield(L, -2, "overruns");
+
+    return 1;
+
+}
+
+// Returns the allocations Lua made during the last frame and the memory it
+// currently uses, small blocks are counted per size class
+static int gameGetAllocStats(lua_State *L)  {
+
+    unsigned int i;
+    PoolStats *stats = &luaPool.last;
+
+    lua_newtable(L);
+    lua_pushinteger(L, stats->allocs);
+    lua_setfield(L, -2, "allocs");
+    lua_pushinteger(L, stats->frees);
+    lua_setfield(L, -2, "frees");
+    lua_pushinteger(L, stats->bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, luaPool.used);
+    lua_setfield(L, -2, "used");
+    lua_pushinteger(L, luaPool.reserved);
+    lua_setfield(L, -2, "reserved");
+
+    // Indexed by block size, 0 holds everything too big for the pool
+    lua_newtable(L);
+    for(i = 0; i < POOL_CLASSES; i++) {
+        lua_pushinteger(L, stats->classAllocs[i]);
+        lua_rawseti(L, -2, (i + 1) * POOL_GRANULARITY);
+    }
+    lua_pushinteger(L, stats->classAllocs[POOL_CLASSES]);
+    lua_rawseti(L, -2, 0);
+    lua_setfield(L, -2, "classes");
+
+    return 1;
+
+}
+
+// Limits the time game.update and game.render may take in milliseconds,
+// overruns are logged with a traceback and optionally aborted
+static int gameSetFrameBudget(lua_State *L)  {
+    double ms = luaL_checknumber(L, 1);
+    luaSetBudget(ms / 1000, luax_optboolean(L, 2, false));
+    return 0;
+}
+
+// Starts sampling the Lua stack, stopping writes the folded stacks to a file
+static int gameProfile(lua_State *L)  {
+
+    if (luax_optboolean(L, 1, true)) {
+        luaProfileStart();
+        lua_pushboolean(L, true);
+
+    } else {
+        lua_pushboolean(L, luaProfileStop(luaL_optstring(L, 2, "profile.folded")));
+    }
+
+    return 1;
+
+}
+
+// Time in milliseconds the garbage collector may use at the end of a frame,
+// 0 lets Lua collect whenever it wants to
+static int gameSetGCBudget(lua_State *L)  {
+    luaSetGCBudget(luaL_checknumber(L, 1) / 1000);
+    return 0;
+}
+
+static int gameShowFrameStats(lua_State *L)  {
+    statsOverlay = luax_optboolean(L, 1, true);
+    return 0;
+}
+
 static int gamePause(lua_State *L)  {
     stateIsPaused = true;
+    graphicsDirty = true;
     return 0;
 }
 
 static int gameResume(lua_State *L)  {
     stateIsPaused = false;
+    graphicsDirty = true;
+    return 0;
+}
+
+// Runs a function as a task which can sleep with game.wait / game.waitFrames
+static int gameSpawn(lua_State *L)  {
+    schedSpawn(L, 1);
     return 0;
 }
 
+// Waits for at least the given number of seconds of unpaused game time
+static int gameWait(lua_State *L)  {
+
+    double ticks = luaL_checknumber(L, 1) * graphicsFrameRate;
+    unsigned long wait = ticks > 0 ? (unsigned long)ticks : 0;
+    if (wait < ticks) {
+        wait++;
+    }
+
+    return schedWait(L, wait);
+
+}
+
+static int gameWaitFrames(lua_State *L)  {
+    int frames = luaL_checkinteger(L, 1);
+    return schedWait(L, frames > 0 ? frames : 1);
+}
+
 static int gameIsPaused(lua_State *L)  {
     lua_pushboolean(L, stateIsPaused);
     return 1;
 }
 
+static int gameIsHeadless(lua_State *L)  {
+    lua_pushboolean(L, stateIsHeadless);
+    return 1;
+}
+
+// Writes the engine zones recorded so far, only works when started with --trace
+static int gameTraceDump(lua_State *L)  {
+    lua_pushboolean(L, traceDump(luaL_optstring(L, 1, NULL)));
+    return 1;
+}
+
+static int gameGetInstance(lua_State *L)  {
+    lua_pushinteger(L, gameInstance);
+    return 1;
+}
+
 
 // ----------------------------------------------------------------------------
 // Keyboard -------------------------------------------------------------------
@@ -134,23 +290,92 @@ static int getKeyCodeFromName(const char *s) {
 
 }
 
+// Keys can be given as one of the keyboard.KEY_* codes or by name, names are
+// resolved once and then cached in the registry, since Lua strings are
+// interned this makes the lookup a single table access
+static int checkKey(lua_State *L, int index) {
+
+    int id;
+
+    if (lua_type(L, index) == LUA_TNUMBER) {
+        id = lua_tointeger(L, index);
+        return id > 0 && id < ALLEGRO_KEY_MAX ? id : 0;
+    }
+
+    luaL_checkstring(L, index);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, keyNames);
+    lua_pushvalue(L, index);
+    lua_rawget(L, -2);
+
+    if (lua_isnil(L, -1)) {
+        id = getKeyCodeFromName(lua_tostring(L, index));
+        lua_pop(L, 1);
+        lua_pushvalue(L, index);
+        lua_pushinteger(L, id);
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+
+    } else {
+        id = lua_tointeger(L, -1);
+        lua_pop(L, 2);
+    }
+
+    return id;
+
+}
+
+// Turns the key names into constants, e.g. "PAD +" becomes KEY_PAD_PLUS, the
+// unnamed KEY60 style placeholders are left out
+static void keyboardConstants() {
+
+    int i, len;
+    const char *c;
+    char name[32];
+
+    for(i = 1; i < ALLEGRO_KEY_MAX; i++) {
+
+        if (strncmp(keyNames[i], "KEY", 3) == 0) {
+            continue;
+        }
+
+        len = sprintf(name, "KEY_");
+        for(c = keyNames[i]; *c != '\0'; c++) {
+            switch(*c) {
+                case ' ': len += sprintf(name + len, "_"); break;
+                case '/': len += sprintf(name + len, "SLASH"); break;
+                case '*': len += sprintf(name + len, "ASTERISK"); break;
+                case '-': len += sprintf(name + len, "MINUS"); break;
+                case '+': len += sprintf(name + len, "PLUS"); break;
+                case '=': len += sprintf(name + len, "EQUALS"); break;
+                default: name[len++] = *c; name[len] = '\0'; break;
+            }
+        }
+
+        lua_pushinteger(L, i);
+        lua_setfield(L, -2, name);
+
+    }
+
+    // Cache for names
+    lua_newtable(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, keyNames);
+
+}
+
 static int keyboardIsDown(lua_State *L) {
-    const char *key = luaL_checkstring(L, 1);
-    int id = getKeyCodeFromName(key);
+    int id = checkKey(L, 1);
     lua_pushboolean(L, id != 0 ? keyStates[id] > 0 : false);
     return 1;
 }
 
 static int keyboardWasPressed(lua_State *L) {
-    const char *key = luaL_checkstring(L, 1);
-    int id = getKeyCodeFromName(key);
+    int id = checkKey(L, 1);
     lua_pushboolean(L, id != 0 ? keyStates[id] == 1 : false);
     return 1;
 }
 
 static int keyboardWasReleased(lua_State *L) {
-    const char *key = luaL_checkstring(L, 1);
-    int id = getKeyCodeFromName(key);
+    int id = checkKey(L, 1);
     lua_pushboolean(L, id != 0 ? keyStates[id] == 0 && keyStatesOld[id] > 0 : false);
     return 1;
 }
@@ -318,12 +543,16 @@ static int graphicsDrawLine(lua_State *L) {
     double x2 = luaL_checkinteger(L, 3) + graphicsRenderOffsetX;
     double y2 = luaL_checkinteger(L, 4) + graphicsRenderOffsetY;
 
+    if (stateIsHeadless) {
+        return 0;
+    }
+
     if (graphicsLineWidth % 2 == 1) {
         x1 += 0.5;
         x2 += 0.5;
     } 
 
-    al_draw_line(x1, y1, x2, y2, graphicsColor, graphicsLineWidth);
+    renderLine(x1, y1, x2, y2, graphicsColor, graphicsLineWidth);
 
     return 0;
 }
@@ -337,8 +566,12 @@ static int graphicsDrawTriangle(lua_State *L) {
     double x3 = luaL_checkinteger(L, 5) + graphicsRenderOffsetX;
     double y3 = luaL_checkinteger(L, 6) + graphicsRenderOffsetY;
 
+    if (stateIsHeadless) {
+        return 0;
+    }
+
     if (luax_optboolean(L, 7, false)) {
-        al_draw_filled_triangle(x1, y1, x2, y2, x3, y3, graphicsColor);
+        renderTriangle(x1, y1, x2, y2, x3, y3, graphicsColor, 0, true);
 
     } else {
 
@@ -351,7 +584,7 @@ static int graphicsDrawTriangle(lua_State *L) {
             y3 += 0.5;
         } 
 
-        al_draw_triangle(x1, y1, x2, y2, x3, y3, graphicsColor, graphicsLineWidth);
+        renderTriangle(x1, y1, x2, y2, x3, y3, graphicsColor, graphicsLineWidth, false);
         
     }
 
@@ -365,15 +598,19 @@ static int graphicsDrawRect(lua_State *L) {
     double w = luaL_checkinteger(L, 3);
     double h = luaL_checkinteger(L, 4);
 
+    if (stateIsHeadless) {
+        return 0;
+    }
+
     if (luax_optboolean(L, 5, false)) {
-        al_draw_filled_rectangle(x, y, x + w, y + h, graphicsColor);
+        renderRect(x, y, x + w, y + h, graphicsColor, 0, true);
         
     } else {
         if (graphicsLineWidth % 2 == 1) {
             x += 0.5;
             y += 0.5;
         }
-        al_draw_rectangle(x, y, x + w - 1, y + h - 1, graphicsColor, graphicsLineWidth);
+        renderRect(x, y, x + w - 1, y + h - 1, graphicsColor, graphicsLineWidth, false);
     }
 
     return 0;
@@ -386,8 +623,13 @@ static int graphicsDrawCircle(lua_State *L) {
     int r = luaL_checkinteger(L, 3);
 
     int filled = luax_optboolean(L, 5, false);
+
+    if (stateIsHeadless) {
+        return 0;
+    }
+
     if (filled) {
-        al_draw_filled_circle(x, y, r, graphicsColor);
+        renderCircle(x, y, r, graphicsColor, 0, true);
         
     } else {
 
@@ -396,12 +638,102 @@ static int graphicsDrawCircle(lua_State *L) {
             y += 0.5;
         } 
 
-        al_draw_circle(x, y, r, graphicsColor, graphicsLineWidth);
+        renderCircle(x, y, r, graphicsColor, graphicsLineWidth, false);
 
     }
     return 0;
 }
 
+// Bulk drawing, these take flat arrays of numbers and record all of them in
+// one go ---------------------------------------------------------------------
+static double bufferGet(lua_State *L, int index, int i) {
+
+    double value;
+
+    lua_rawgeti(L, index, i);
+    value = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+    return value;
+
+}
+
+// { x1, y1, x2, y2, ... }
+static int graphicsDrawLines(lua_State *L) {
+
+    int i, len;
+    double x1, y1, x2, y2, offset;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    len = lua_rawlen(L, 1);
+
+    if (stateIsHeadless) {
+        return 0;
+    }
+
+    offset = graphicsLineWidth % 2 == 1 ? 0.5 : 0;
+    for(i = 1; i + 3 <= len; i += 4) {
+        x1 = (int)bufferGet(L, 1, i) + graphicsRenderOffsetX + offset;
+        y1 = (int)bufferGet(L, 1, i + 1) + graphicsRenderOffsetY;
+        x2 = (int)bufferGet(L, 1, i + 2) + graphicsRenderOffsetX + offset;
+        y2 = (int)bufferGet(L, 1, i + 3) + graphicsRenderOffsetY;
+        renderLine(x1, y1, x2, y2, graphicsColor, graphicsLineWidth);
+    }
+
+    return 0;
+
+}
+
+// { x, y, w, h, ... }
+static int graphicsDrawRects(lua_State *L) {
+
+    int i, len;
+    double x, y, w, h, offset;
+    bool filled;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    len = lua_rawlen(L, 1);
+    filled = luax_optboolean(L, 2, false);
+
+    if (stateIsHeadless) {
+        return 0;
+    }
+
+    offset = !filled && graphicsLineWidth % 2 == 1 ? 0.5 : 0;
+    for(i = 1; i + 3 <= len; i += 4) {
+
+        x = (int)bufferGet(L, 1, i) + graphicsRenderOffsetX + offset;
+        y = (int)bufferGet(L, 1, i + 1) + graphicsRenderOffsetY + offset;
+        w = (int)bufferGet(L, 1, i + 2);
+        h = (int)bufferGet(L, 1, i + 3);
+
+        if (filled) {
+            renderRect(x, y, x + w, y + h, graphicsColor, 0, true);
+
+        } else {
+            renderRect(x, y, x + w - 1, y + h - 1, graphicsColor, graphicsLineWidth, false);
+        }
+
+    }
+
+    return 0;
+
+}
+
+static int graphicsInvalidate(lua_State *L) {
+    graphicsDirty = true;
+    return 0;
+}
+
+static int graphicsSetKeepAlive(lua_State *L) {
+    graphicsKeepAlive = luaL_checkinteger(L, 1);
+    return 0;
+}
+
+static int graphicsGetKeepAlive(lua_State *L) {
+    lua_pushinteger(L, graphicsKeepAlive);
+    return 1;
+}
+
 static int graphicsSetScale(lua_State *L) {
 
     int s = luaL_checkinteger(L, 1);
@@ -442,63 +774,85 @@ static int graphicsGetSize(lua_State *L) {
 // ----------------------------------------------------------------------------
 // Image ----------------------------------------------------------------------
 // ----------------------------------------------------------------------------
-struct ImageTile;
-typedef struct ImageTile {
-    int cols;
-    int rows;
+static void pushHandle(lua_State *L, const char *type, void *resource, const char *name) {
+    Handle *handle = (Handle*)lua_newuserdata(L, sizeof(Handle) + strlen(name) + 1);
+    handle->resource = resource;
+    strcpy(handle->name, name);
+    luaL_setmetatable(L, type);
+}
+
+// Returns the kind and name of a handle, see dataWriteValue
+static int handleResource(lua_State *L) {
+    Handle *handle = (Handle*)lua_touserdata(L, 1);
+    luaL_getmetafield(L, 1, "__type");
+    lua_pushstring(L, handle->name);
+    return 2;
+}
 
-} ImageTile;
+static void handleRegister(lua_State *L, const char *type) {
+    luaL_newmetatable(L, type);
+    lua_pushstring(L, type);
+    lua_setfield(L, -2, "__type");
+    lua_pushcfunction(L, handleResource);
+    lua_setfield(L, -2, "__resource");
+    lua_pop(L, 1);
+}
 
-static ALLEGRO_BITMAP *getImage(const char *filename) {
+// Images are kept by filename, but Lua can hold on to the loaded Image and
+// pass it back in to skip the lookup
+static Image *getImage(const char *filename) {
     
-    ALLEGRO_BITMAP *img = NULL;
-    ImageTile *tile = NULL;
+    Image *img = (Image*)graphicsImages->get(graphicsImages, filename);
 
     // Check if we need to load the image
-    if (!graphicsImages->hasKey(graphicsImages, filename)) {
+    if (img == NULL) {
         
-        img = ioLoadBitmap(filename);
-        if (!img) {
+        img = (Image*)calloc(1, sizeof(Image));
+        img->cols = 1;
+        img->rows = 1;
+
+        renderAcquire();
+        img->bitmap = ioLoadBitmap(filename);
+        renderRelease();
+
+        if (!img->bitmap) {
             gameExit("Failed to load image");
         }
 
         graphicsImages->set(graphicsImages, filename, img);
-
-        tile = calloc(1, sizeof(ImageTile));
-        tile->cols = 1;
-        tile->rows = 1;
-
-        graphicsImageTiles->set(graphicsImageTiles, filename, tile);
-
         printf("image: %s loaded\n", filename);
         
-    } else {
-        img = (ALLEGRO_BITMAP*)graphicsImages->get(graphicsImages, filename);
     }
 
     return img;
 
 }
 
+// Accepts either a handle returned by image.load or a filename
+static Image *checkImage(lua_State *L, int index) {
+    if (lua_isuserdata(L, index)) {
+        return (Image*)((Handle*)luaL_checkudata(L, index, IMAGE_TYPE))->resource;
+
+    } else {
+        return getImage(luaL_checkstring(L, index));
+    }
+}
+
 static int imageLoad(lua_State *L) {
     const char* filename = luaL_checkstring(L, 1);
-    getImage(filename);
-    return 0;
+    pushHandle(L, IMAGE_TYPE, getImage(filename), filename);
+    return 1;
 }
 
 
 static int imageSetTiles(lua_State *L) {
 
-    const char* filename = luaL_checkstring(L, 1);
+    Image *img = checkImage(L, 1);
     int cols = luaL_checkinteger(L, 2);
     int rows = luaL_checkinteger(L, 3);
-    ImageTile *tile = NULL;
-
-    getImage(filename);
 
-    tile = (ImageTile*)graphicsImageTiles->get(graphicsImageTiles, filename);
-    tile->cols = cols;
-    tile->rows = rows;
+    img->cols = cols;
+    img->rows = rows;
 
     return 0;
 
@@ -506,8 +860,7 @@ static int imageSetTiles(lua_State *L) {
 
 static int imageDraw(lua_State *L) {
 
-    const char* filename = luaL_checkstring(L, 1);
-    ALLEGRO_BITMAP *img = getImage(filename);
+    Image *img = checkImage(L, 1);
 
     int x = luaL_checkinteger(L, 2) + graphicsRenderOffsetX; 
     int y = luaL_checkinteger(L, 3) + graphicsRenderOffsetY; 
@@ -522,32 +875,30 @@ static int imageDraw(lua_State *L) {
         flags |= ALLEGRO_FLIP_VERTICAL;
     }
 
-    if (a == 1) {
-        al_draw_bitmap(img, x, y, flags);
-
-    } else {
-        al_draw_tinted_bitmap(img, al_map_rgba_f(1, 1, 1, a), x, y, flags);
+    if (stateIsHeadless) {
+        return 0;
     }
 
+    renderBitmap(img->bitmap, 0, 0, al_get_bitmap_width(img->bitmap), al_get_bitmap_height(img->bitmap), 
+                 x, y, al_map_rgba_f(1, 1, 1, a), flags);
+
     return 0;
 
 }
 
 static int imageDrawTile(lua_State *L) {
 
-    const char* filename = luaL_checkstring(L, 1);
-    ALLEGRO_BITMAP *img = getImage(filename);
-    ImageTile *tile = (ImageTile*)graphicsImageTiles->get(graphicsImageTiles, filename);
+    Image *img = checkImage(L, 1);
 
     int x = luaL_checkinteger(L, 2) + graphicsRenderOffsetX; 
     int y = luaL_checkinteger(L, 3) + graphicsRenderOffsetY; 
     int index = luaL_checkinteger(L, 4) - 1;
     double a = luaL_optnumber(L, 7, 1);
 
-    int w = al_get_bitmap_width(img) / tile->cols;
-    int h = al_get_bitmap_height(img) / tile->rows;
-    int ty = index / tile->rows;
-    int tx = index - ty * tile->cols;
+    int w = al_get_bitmap_width(img->bitmap) / img->cols;
+    int h = al_get_bitmap_height(img->bitmap) / img->rows;
+    int ty = index / img->cols;
+    int tx = index - ty * img->cols;
 
     int flags = 0;
     if (luax_optboolean(L, 5, false)) {
@@ -558,11 +909,43 @@ static int imageDrawTile(lua_State *L) {
         flags |= ALLEGRO_FLIP_VERTICAL;
     }
 
-    if (a == 1) {
-        al_draw_bitmap_region(img, tx * w, ty * h, w, h, x, y, flags);
+    if (stateIsHeadless) {
+        return 0;
+    }
+
+    renderBitmap(img->bitmap, tx * w, ty * h, w, h, x, y, al_map_rgba_f(1, 1, 1, a), flags);
+
+    return 0;
+
+}
+
+// { x, y, index, ... } all drawn from the same tile set
+static int imageDrawTiles(lua_State *L) {
+
+    Image *img = checkImage(L, 1);
+    ALLEGRO_COLOR tint = al_map_rgba_f(1, 1, 1, luaL_optnumber(L, 3, 1));
+
+    int w = al_get_bitmap_width(img->bitmap) / img->cols;
+    int h = al_get_bitmap_height(img->bitmap) / img->rows;
+    int i, len, x, y, index, tx, ty;
+
+    luaL_checktype(L, 2, LUA_TTABLE);
+    len = lua_rawlen(L, 2);
+
+    if (stateIsHeadless) {
+        return 0;
+    }
+
+    for(i = 1; i + 2 <= len; i += 3) {
+
+        x = (int)bufferGet(L, 2, i) + graphicsRenderOffsetX;
+        y = (int)bufferGet(L, 2, i + 1) + graphicsRenderOffsetY;
+        index = (int)bufferGet(L, 2, i + 2) - 1;
+
+        ty = index / img->cols;
+        tx = index - ty * img->cols;
+        renderBitmap(img->bitmap, tx * w, ty * h, w, h, x, y, tint, 0);
 
-    } else {
-        al_draw_tinted_bitmap_region(img, al_map_rgba_f(1, 1, 1, a), tx * w, ty * h, w, h, x, y, flags);
     }
 
     return 0;
@@ -584,7 +967,13 @@ static ALLEGRO_SAMPLE *getSound(const char *filename) {
     
     ALLEGRO_SAMPLE *snd = NULL;
 
-    if (!soundSamples->hasKey(soundSamples, filename)) {
+    // There's no audio device to load samples for
+    if (stateIsHeadless) {
+        return NULL;
+    }
+
+    snd = (ALLEGRO_SAMPLE*)soundSamples->get(soundSamples, filename);
+    if (snd == NULL) {
         
         snd = ioLoadSample(filename);
         if (!snd) {
@@ -593,18 +982,18 @@ static ALLEGRO_SAMPLE *getSound(const char *filename) {
     
         soundSamples->set(soundSamples, filename, snd);
         
-    } else {
-        snd = (ALLEGRO_SAMPLE*)soundSamples->get(soundSamples, filename);
     }
 
     return snd;
 
 }
 
+// Returns a handle which can be passed to sound.play instead of the filename,
+// without audio the handle is still valid but plays nothing
 static int soundLoad(lua_State *L) {
     const char* filename = luaL_checkstring(L, 1);
-    getSound(filename);
-    return 0;
+    pushHandle(L, SOUND_TYPE, getSound(filename), filename);
+    return 1;
 }
 
 static int soundPlay(lua_State *L) {
@@ -614,14 +1003,17 @@ static int soundPlay(lua_State *L) {
     float speed = luaL_optnumber(L, 3, 1);
     ALLEGRO_SAMPLE_ID id;
 
-    // If we supply a string create a new sample and return the id
-    if (lua_isstring(L, 1)) {
-        const char* filename = luaL_checkstring(L, 1);
-        snd = getSound(filename);
-        
-    // Otherwise modify the existing one
+    // Either a handle from sound.load or a filename
+    if (lua_isuserdata(L, 1)) {
+        snd = (ALLEGRO_SAMPLE*)((Handle*)luaL_checkudata(L, 1, SOUND_TYPE))->resource;
+
     } else {
-        
+        snd = getSound(luaL_checkstring(L, 1));
+    }
+
+    if (stateIsHeadless || snd == NULL) {
+        lua_pushboolean(L, false);
+        return 1;
     }
 
     if (al_play_sample(snd, 1, pan, speed, ALLEGRO_PLAYMODE_ONCE, &id)) {
@@ -655,6 +1047,10 @@ static int soundStop(lua_State *L) {
 // ----------------------------------------------------------------------------
 void apiInit() {
 
+    // Handles
+    handleRegister(L, IMAGE_TYPE);
+    handleRegister(L, SOUND_TYPE);
+
     // Fixes
     lua_getglobal(L, "math");
     expose("round", mathRound);
@@ -662,11 +1058,26 @@ void apiInit() {
 
     lua_getglobal(L, "game");
     expose("getTime", gameGetTime);
+    expose("getTick", gameGetTick);
+    expose("getTimeNs", gameGetTimeNs);
     expose("getTimeDelta", gameGetDelta);
+    expose("getTimeAlpha", gameGetAlpha);
     expose("quit", gameQuit);
     expose("pause", gamePause);
     expose("resume", gameResume);
     expose("isPaused", gameIsPaused);
+    expose("spawn", gameSpawn);
+    expose("wait", gameWait);
+    expose("waitFrames", gameWaitFrames);
+    expose("isHeadless", gameIsHeadless);
+    expose("getInstance", gameGetInstance);
+    expose("getAllocStats", gameGetAllocStats);
+    expose("profile", gameProfile);
+    expose("setGCBudget", gameSetGCBudget);
+    expose("traceDump", gameTraceDump);
+    expose("getFrameStats", gameGetFrameStats);
+    expose("showFrameStats", gameShowFrameStats);
+    expose("setFrameBudget", gameSetFrameBudget);
     lua_pop(L, 1);
 
     // Keyboard
@@ -676,6 +1087,7 @@ void apiInit() {
     expose("wasReleased", keyboardWasReleased);
     expose("hasFocus", keyboardHasFocus);
     expose("getCount", keyboardGetCount);
+    keyboardConstants();
     lua_pop(L, 1);
 
     // Mouse
@@ -694,6 +1106,9 @@ void apiInit() {
     expose("getSize", graphicsGetSize);
     expose("getScale", graphicsGetScale);
     expose("setScale", graphicsSetScale);
+    expose("invalidate", graphicsInvalidate);
+    expose("setKeepAlive", graphicsSetKeepAlive);
+    expose("getKeepAlive", graphicsGetKeepAlive);
 
     expose("setRenderOffset", graphicsSetRenderOffset);
     expose("getRenderOffset", graphicsGetRenderOffset);
@@ -707,6 +1122,8 @@ void apiInit() {
     expose("line", graphicsDrawLine);
     expose("triangle", graphicsDrawTriangle);
     expose("rect", graphicsDrawRect);
+    expose("lines", graphicsDrawLines);
+    expose("rects", graphicsDrawRects);
     expose("circle", graphicsDrawCircle);
     lua_pop(L, 1);
 
@@ -716,6 +1133,7 @@ void apiInit() {
     expose("draw", imageDraw);
     expose("setTiles", imageSetTiles);
     expose("drawTile", imageDrawTile);
+    expose("drawTiles", imageDrawTiles);
     lua_pop(L, 1);
 
 
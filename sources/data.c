@@ -0,0 +1,651 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/data.h"
+
+// Serializing always happens into the same buffer, so taking a snapshot
+// every frame doesn't allocate once the buffer is big enough
+typedef struct DataBuffer {
+    char *data;
+    size_t length;
+    size_t size;
+
+} DataBuffer;
+
+static THREAD_LOCAL DataBuffer dataBuffer;
+
+// Stack slots used while (de)serializing
+typedef struct DataState {
+    lua_State *L;
+    int refs;
+    int classes;
+    int count;
+    const char *pos;
+    const char *end;
+
+} DataState;
+
+
+// ----------------------------------------------------------------------------
+// Writing --------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static void dataWrite(const void *p, size_t len) {
+
+    if (dataBuffer.length + len > dataBuffer.size) {
+
+        size_t size = dataBuffer.size ? dataBuffer.size : 256;
+        while(size < dataBuffer.length + len) {
+            size *= 2;
+        }
+
+        dataBuffer.data = (char*)realloc(dataBuffer.data, size);
+        dataBuffer.size = size;
+
+    }
+
+    memcpy(dataBuffer.data + dataBuffer.length, p, len);
+    dataBuffer.length += len;
+
+}
+
+static void dataWriteByte(unsigned char b) {
+    dataWrite(&b, 1);
+}
+
+static void dataWriteVarint(unsigned long value) {
+    while(value >= 0x80) {
+        dataWriteByte((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    dataWriteByte(value);
+}
+
+static void dataWriteNumbers(const lua_Number *n, int count) {
+    dataWrite(n, sizeof(lua_Number) * count);
+}
+
+static void dataWriteValue(DataState *s, int index, int depth);
+
+// Numbers without a fraction are stored as zigzag varints
+static void dataWriteNumber(lua_Number n) {
+
+    long i = n > -0x40000000L && n < 0x40000000L ? (long)n : 0;
+    if ((lua_Number)i == n) {
+        dataWriteByte(DATA_INTEGER);
+        dataWriteVarint(i < 0 ? ((unsigned long)(-i) << 1) - 1 : (unsigned long)i << 1);
+
+    } else {
+        dataWriteByte(DATA_NUMBER);
+        dataWriteNumbers(&n, 1);
+    }
+
+}
+
+static void dataWriteString(lua_State *L, int index) {
+    size_t len;
+    const char *str = lua_tolstring(L, index, &len);
+    dataWriteVarint(len);
+    dataWrite(str, len);
+}
+
+// Array part first, then all remaining pairs ending with a nil key
+static void dataWriteTable(DataState *s, int index, int depth) {
+
+    lua_State *L = s->L;
+    size_t i, len = lua_rawlen(L, index);
+    lua_Number key;
+
+    dataWriteVarint(len);
+    for(i = 1; i <= len; i++) {
+        lua_rawgeti(L, index, i);
+        dataWriteValue(s, lua_gettop(L), depth + 1);
+        lua_pop(L, 1);
+    }
+
+    lua_pushnil(L);
+    while(lua_next(L, index)) {
+
+        if (lua_type(L, -2) == LUA_TNUMBER) {
+            key = lua_tonumber(L, -2);
+            if (key >= 1 && key <= len && key == (size_t)key) {
+                lua_pop(L, 1);
+                continue;
+            }
+        }
+
+        dataWriteValue(s, lua_gettop(L) - 1, depth + 1);
+        dataWriteValue(s, lua_gettop(L), depth + 1);
+        lua_pop(L, 1);
+
+    }
+
+    dataWriteByte(DATA_NIL);
+
+}
+
+// Writes a back reference for tables and sets that were already written,
+// otherwise remembers them for later
+static bool dataWriteRef(DataState *s, int index) {
+
+    lua_State *L = s->L;
+
+    lua_pushvalue(L, index);
+    lua_rawget(L, s->refs);
+    if (!lua_isnil(L, -1)) {
+        dataWriteByte(DATA_REF);
+        dataWriteVarint(lua_tointeger(L, -1));
+        lua_pop(L, 1);
+        return true;
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, index);
+    lua_pushinteger(L, s->count++);
+    lua_rawset(L, s->refs);
+    return false;
+
+}
+
+// Sets only need their items in order
+static void dataWriteSet(DataState *s, int index, int depth) {
+
+    lua_State *L = s->L;
+    size_t i, len = ((Set*)lua_touserdata(L, index))->count;
+    int items;
+
+    lua_getuservalue(L, index);
+    lua_rawgeti(L, -1, SET_ITEMS);
+    items = lua_gettop(L);
+
+    dataWriteVarint(len);
+    for(i = 1; i <= len; i++) {
+        lua_rawgeti(L, items, i);
+        dataWriteValue(s, lua_gettop(L), depth + 1);
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 2);
+
+}
+
+static void dataWriteValue(DataState *s, int index, int depth) {
+
+    lua_State *L = s->L;
+    void *p;
+
+    if (depth > DATA_MAX_DEPTH) {
+        luaL_error(L, "serialize: nesting too deep");
+    }
+
+    luaL_checkstack(L, 6, "serialize");
+    switch(lua_type(L, index)) {
+
+        case LUA_TNIL:
+            dataWriteByte(DATA_NIL);
+            break;
+
+        case LUA_TBOOLEAN:
+            dataWriteByte(lua_toboolean(L, index) ? DATA_TRUE : DATA_FALSE);
+            break;
+
+        case LUA_TNUMBER:
+            dataWriteNumber(lua_tonumber(L, index));
+            break;
+
+        case LUA_TSTRING:
+            dataWriteByte(DATA_STRING);
+            dataWriteString(L, index);
+            break;
+
+        case LUA_TLIGHTUSERDATA:
+            luaL_error(L, "serialize: unsupported light userdata");
+            break;
+
+        case LUA_TUSERDATA:
+
+            // Handles to loaded resources are written by kind and name and
+            // loaded again when read
+            if (luaL_getmetafield(L, index, "__resource")) {
+                lua_pushvalue(L, index);
+                lua_call(L, 1, 2);
+                dataWriteByte(DATA_RESOURCE);
+                dataWriteString(L, -2);
+                dataWriteString(L, -1);
+                lua_pop(L, 2);
+
+            } else if ((p = luaL_testudata(L, index, VEC2_TYPE)) != NULL) {
+                dataWriteByte(DATA_VEC2);
+                dataWriteNumbers(&((Vec2*)p)->x, 2);
+
+            } else if ((p = luaL_testudata(L, index, AABB_TYPE)) != NULL) {
+                dataWriteByte(DATA_AABB);
+                dataWriteNumbers(&((AABB*)p)->x, 4);
+
+            } else if (luaL_testudata(L, index, SET_TYPE) != NULL) {
+                if (!dataWriteRef(s, index)) {
+                    dataWriteByte(DATA_SET);
+                    dataWriteSet(s, index, depth);
+                }
+
+            } else {
+                luaL_error(L, "serialize: unsupported userdata");
+            }
+            break;
+
+        case LUA_TTABLE:
+
+            // Classes themselves are only referenced by name
+            lua_pushvalue(L, index);
+            lua_rawget(L, s->classes);
+            if (!lua_isnil(L, -1)) {
+                dataWriteByte(DATA_CLASS);
+                dataWriteString(L, -1);
+                lua_pop(L, 1);
+                break;
+            }
+            lua_pop(L, 1);
+
+            if (dataWriteRef(s, index)) {
+                break;
+            }
+
+            // Instances of a class get their metatable back by name
+            if (lua_getmetatable(L, index)) {
+
+                lua_rawget(L, s->classes);
+                if (!lua_isnil(L, -1)) {
+                    dataWriteByte(DATA_INSTANCE);
+                    dataWriteString(L, -1);
+
+                } else {
+                    dataWriteByte(DATA_TABLE);
+                }
+                lua_pop(L, 1);
+
+            } else {
+                dataWriteByte(DATA_TABLE);
+            }
+
+            dataWriteTable(s, index, depth);
+            break;
+
+        default:
+            luaL_error(L, "serialize: can't serialize a %s", luaL_typename(L, index));
+            break;
+
+    }
+
+}
+
+// Maps every class in __class_cache to its name
+static void dataPushClasses(lua_State *L) {
+
+    lua_newtable(L);
+    lua_getglobal(L, "__class_cache");
+
+    if (lua_istable(L, -1)) {
+        lua_pushnil(L);
+        while(lua_next(L, -2)) {
+            lua_pushvalue(L, -2);
+            lua_rawset(L, -5);
+        }
+    }
+
+    lua_pop(L, 1);
+
+}
+
+// Returns the serialized form of the value at index, the buffer is reused by
+// the next call on the same thread
+const char *dataSerialize(lua_State *L, int index, size_t *len) {
+
+    DataState s;
+
+    index = lua_absindex(L, index);
+    s.L = L;
+    s.count = 0;
+
+    lua_newtable(L);
+    s.refs = lua_gettop(L);
+    dataPushClasses(L);
+    s.classes = lua_gettop(L);
+
+    dataBuffer.length = 0;
+    dataWriteByte(DATA_VERSION);
+    dataWriteValue(&s, index, 0);
+
+    lua_pop(L, 2);
+    *len = dataBuffer.length;
+    return dataBuffer.data;
+
+}
+
+
+// ----------------------------------------------------------------------------
+// Reading --------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static void dataRead(DataState *s, void *p, size_t len) {
+
+    if ((size_t)(s->end - s->pos) < len) {
+        luaL_error(s->L, "deserialize: unexpected end of data");
+    }
+
+    memcpy(p, s->pos, len);
+    s->pos += len;
+
+}
+
+static unsigned char dataReadByte(DataState *s) {
+    unsigned char b;
+    dataRead(s, &b, 1);
+    return b;
+}
+
+static unsigned long dataReadVarint(DataState *s) {
+
+    unsigned long value = 0;
+    unsigned int shift = 0;
+    unsigned char b;
+
+    do {
+        b = dataReadByte(s);
+        value |= (unsigned long)(b & 0x7f) << shift;
+        shift += 7;
+
+    } while(b & 0x80 && shift < 64);
+
+    return value;
+
+}
+
+static void dataReadString(DataState *s) {
+
+    size_t len = dataReadVarint(s);
+    if ((size_t)(s->end - s->pos) < len) {
+        luaL_error(s->L, "deserialize: unexpected end of data");
+    }
+
+    lua_pushlstring(s->L, s->pos, len);
+    s->pos += len;
+
+}
+
+static bool dataReadValue(DataState *s, int depth);
+
+// Looks up a class by name in __class_cache
+static void dataReadClass(DataState *s) {
+
+    lua_State *L = s->L;
+
+    dataReadString(s);
+    lua_rawget(L, s->classes);
+    if (!lua_istable(L, -1)) {
+        luaL_error(L, "deserialize: unknown class");
+    }
+
+}
+
+static void dataReadTable(DataState *s, int depth) {
+
+    lua_State *L = s->L;
+    size_t i, len = dataReadVarint(s);
+    int table;
+
+    lua_createtable(L, len > 1024 ? 1024 : len, 0);
+    table = lua_gettop(L);
+
+    // Register before reading the contents, they may refer back to it
+    lua_pushvalue(L, table);
+    lua_rawseti(L, s->refs, ++s->count);
+
+    for(i = 1; i <= len; i++) {
+        dataReadValue(s, depth + 1);
+        lua_rawseti(L, table, i);
+    }
+
+    while(dataReadValue(s, depth + 1)) {
+        dataReadValue(s, depth + 1);
+        lua_rawset(L, table);
+    }
+
+    // Trailing nil key
+    lua_pop(L, 1);
+
+}
+
+static void dataReadSet(DataState *s, int depth) {
+
+    lua_State *L = s->L;
+    size_t i, len = dataReadVarint(s);
+    int set;
+
+    setPush(L);
+    set = lua_gettop(L);
+
+    lua_pushvalue(L, set);
+    lua_rawseti(L, s->refs, ++s->count);
+
+    for(i = 0; i < len; i++) {
+        if (dataReadValue(s, depth + 1)) {
+            setAdd(L, set, -1);
+        }
+        lua_pop(L, 1);
+    }
+
+}
+
+// Loads a resource again through e.g. image.load
+static void dataReadResource(DataState *s) {
+
+    lua_State *L = s->L;
+    int type;
+
+    dataReadString(s);
+    type = lua_gettop(L);
+    dataReadString(s);
+
+    // Only kinds whose handles can be written out may be loaded, anything
+    // else in the buffer must not pick a global to call
+    luaL_getmetatable(L, lua_tostring(L, type));
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, "__type");
+        lua_getfield(L, -2, "__resource");
+    }
+
+    if (!lua_istable(L, type + 2) || !lua_iscfunction(L, -1) || !lua_rawequal(L, type, -2)) {
+        luaL_error(L, "deserialize: can't load %s resources", lua_tostring(L, type));
+    }
+    lua_settop(L, type + 1);
+
+    lua_getglobal(L, lua_tostring(L, type));
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, "load");
+        lua_remove(L, -2);
+    }
+
+    if (!lua_isfunction(L, -1)) {
+        luaL_error(L, "deserialize: can't load %s resources", lua_tostring(L, type));
+    }
+
+    lua_insert(L, type + 1);
+    lua_call(L, 1, 1);
+    lua_replace(L, type);
+
+}
+
+// Pushes the next value, returns false for nil
+static bool dataReadValue(DataState *s, int depth) {
+
+    lua_State *L = s->L;
+    unsigned long u;
+    lua_Number n[4];
+
+    if (depth > DATA_MAX_DEPTH) {
+        luaL_error(L, "deserialize: nesting too deep");
+    }
+
+    luaL_checkstack(L, 6, "deserialize");
+    switch(dataReadByte(s)) {
+
+        case DATA_NIL:
+            lua_pushnil(L);
+            return false;
+
+        case DATA_FALSE:
+            lua_pushboolean(L, false);
+            break;
+
+        case DATA_TRUE:
+            lua_pushboolean(L, true);
+            break;
+
+        case DATA_INTEGER:
+            u = dataReadVarint(s);
+            lua_pushnumber(L, u & 1 ? -(lua_Number)((u + 1) >> 1) : (lua_Number)(u >> 1));
+            break;
+
+        case DATA_NUMBER:
+            dataRead(s, n, sizeof(lua_Number));
+            lua_pushnumber(L, n[0]);
+            break;
+
+        case DATA_STRING:
+            dataReadString(s);
+            break;
+
+        case DATA_TABLE:
+            dataReadTable(s, depth);
+            break;
+
+        case DATA_INSTANCE:
+            dataReadClass(s);
+            dataReadTable(s, depth);
+            lua_insert(L, -2);
+            lua_setmetatable(L, -2);
+            break;
+
+        case DATA_CLASS:
+            dataReadClass(s);
+            break;
+
+        case DATA_REF:
+            lua_rawgeti(L, s->refs, dataReadVarint(s) + 1);
+            if (lua_isnil(L, -1)) {
+                luaL_error(L, "deserialize: invalid reference");
+            }
+            break;
+
+        case DATA_VEC2:
+            dataRead(s, n, sizeof(lua_Number) * 2);
+            vecPush(L, n[0], n[1]);
+            break;
+
+        case DATA_AABB:
+            dataRead(s, n, sizeof(lua_Number) * 4);
+            aabbPush(L, n[0], n[1], n[2], n[3]);
+            break;
+
+        case DATA_RESOURCE:
+            dataReadResource(s);
+            break;
+
+        case DATA_SET:
+            dataReadSet(s, depth);
+            break;
+
+        default:
+            luaL_error(L, "deserialize: invalid data");
+            break;
+
+    }
+
+    return true;
+
+}
+
+// Pushes the value stored in buf
+void dataDeserialize(lua_State *L, const char *buf, size_t len) {
+
+    DataState s;
+
+    s.L = L;
+    s.count = 0;
+    s.pos = buf;
+    s.end = buf + len;
+
+    lua_newtable(L);
+    s.refs = lua_gettop(L);
+
+    // By name this time
+    lua_getglobal(L, "__class_cache");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+    }
+    s.classes = lua_gettop(L);
+
+    if (dataReadByte(&s) != DATA_VERSION) {
+        luaL_error(L, "deserialize: unsupported version");
+    }
+
+    dataReadValue(&s, 0);
+    lua_insert(L, s.refs);
+    lua_pop(L, 2);
+
+}
+
+
+// ----------------------------------------------------------------------------
+// Lua ------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static int dataLuaSerialize(lua_State *L) {
+
+    size_t len;
+    const char *buf;
+
+    luaL_checkany(L, 1);
+    buf = dataSerialize(L, 1, &len);
+    lua_pushlstring(L, buf, len);
+    return 1;
+
+}
+
+static int dataLuaDeserialize(lua_State *L) {
+    size_t len;
+    const char *buf = luaL_checklstring(L, 1, &len);
+    dataDeserialize(L, buf, len);
+    return 1;
+}
+
+void dataInit(lua_State *L) {
+
+    lua_newtable(L);
+
+    lua_pushcfunction(L, dataLuaSerialize);
+    lua_setfield(L, -2, "serialize");
+
+    lua_pushcfunction(L, dataLuaDeserialize);
+    lua_setfield(L, -2, "deserialize");
+
+    lua_setglobal(L, "data");
+
+}
+
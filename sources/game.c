@@ -28,53 +28,63 @@ const int defaultWidth = 640;
 const int defaultHeight = 480;
 const int defaultScale = 1;
 const int defaultFrameRate = 60;
+const int defaultKeepAlive = 1;
 
 // State and Time
-bool stateIsRunning = false;
-bool stateIsPaused = false;
-bool stateHasKeyboard = false;
-bool stateHasMouse = false;
-bool stateReload = false;
-
-double gameTime = 0;
-double gameTimeDelta = 0;
+THREAD_LOCAL int gameInstance = 0;
+THREAD_LOCAL bool stateIsRunning = false;
+THREAD_LOCAL bool stateIsPaused = false;
+THREAD_LOCAL bool stateHasKeyboard = false;
+THREAD_LOCAL bool stateHasMouse = false;
+THREAD_LOCAL bool stateReload = false;
+bool stateIsHeadless = false;
+
+THREAD_LOCAL uint64_t gameTick = 0;
+THREAD_LOCAL uint64_t gameTimeNs = 0;
+THREAD_LOCAL double gameTime = 0;
+THREAD_LOCAL double gameTimeDelta = 0;
+THREAD_LOCAL double gameTimeAlpha = 0;
 ALLEGRO_EVENT_QUEUE *stateEventQueue = NULL;
 ALLEGRO_TIMER *stateTimer = NULL;
 
+// Maximum number of fixed updates to catch up on within a single frame
+#define MAX_FRAME_STEPS 5
+
 // Input
-#define MAX_MOUSE 8
-int mouseX = -1;
-int mouseY = -1;
-int mouseCount = 0;
-int mouseStates[MAX_MOUSE];
-int mouseStatesOld[MAX_MOUSE];
+THREAD_LOCAL int mouseX = -1;
+THREAD_LOCAL int mouseY = -1;
+THREAD_LOCAL int mouseCount = 0;
+THREAD_LOCAL int mouseStates[MAX_MOUSE];
+THREAD_LOCAL int mouseStatesOld[MAX_MOUSE];
 
-int keyCount = 0;
-int keyStates[ALLEGRO_KEY_MAX];
-int keyStatesOld[ALLEGRO_KEY_MAX];
+THREAD_LOCAL int keyCount = 0;
+THREAD_LOCAL int keyStates[ALLEGRO_KEY_MAX];
+THREAD_LOCAL int keyStatesOld[ALLEGRO_KEY_MAX];
 
 // Graphics
-const char* graphicsTitle = "";
-int graphicsWidth = 0;
-int graphicsHeight = 0;
-int graphicsScale = 0;
-bool graphicsResized = false;
-int graphicsFrameRate = 60;
-int graphicsLineWidth = 1;
-ALLEGRO_COLOR graphicsColor;
-ALLEGRO_COLOR graphicsBackgroundColor;
+THREAD_LOCAL const char* graphicsTitle = "";
+THREAD_LOCAL int graphicsWidth = 0;
+THREAD_LOCAL int graphicsHeight = 0;
+THREAD_LOCAL int graphicsScale = 0;
+THREAD_LOCAL bool graphicsResized = false;
+bool graphicsThreaded = false;
+THREAD_LOCAL bool graphicsDirty = true;
+THREAD_LOCAL int graphicsKeepAlive = 1;
+THREAD_LOCAL int graphicsFrameRate = 60;
+THREAD_LOCAL int graphicsLineWidth = 1;
+THREAD_LOCAL ALLEGRO_COLOR graphicsColor;
+THREAD_LOCAL ALLEGRO_COLOR graphicsBackgroundColor;
 ALLEGRO_DISPLAY *graphicsDisplay = NULL;
 ALLEGRO_BITMAP *graphicsBackground = NULL;
 
-int graphicsRenderOffsetX = 0;
-int graphicsRenderOffsetY = 0;
+THREAD_LOCAL int graphicsRenderOffsetX = 0;
+THREAD_LOCAL int graphicsRenderOffsetY = 0;
 
 // Images
-HashMap *graphicsImages;
-HashMap *graphicsImageTiles;
+THREAD_LOCAL HashMap *graphicsImages;
 
 // Sounds
-HashMap *soundSamples;
+THREAD_LOCAL HashMap *soundSamples;
 
 
 
@@ -86,6 +96,27 @@ void gameExit(const char *msg) {
     exit(1);
 }
 
+// Initializes Allegro itself, this is shared by all instances and needs to
+// happen once before any of them is loaded
+void gameInitSystem() {
+
+    static bool initialized = false;
+    if (initialized) {
+        return;
+    }
+
+	if (!al_init()) {
+        gameExit("Failed to initialize allegro.");
+    }
+
+	if (!al_init_image_addon() || !al_init_primitives_addon()) {
+        gameExit("Failed to initialize allegro graphics.");
+    }
+
+    initialized = true;
+
+}
+
 void gameLoad() {
     
     unsigned int i;
@@ -100,12 +131,20 @@ void gameLoad() {
     for(i = 0; i < MAX_MOUSE; i++) mouseStates[i] = 0;
 
     // Init Allegro
-	if (!al_init()) {
-        gameExit("Failed to initialize allegro.");
-    }
+    gameInitSystem();
 
-	if (!al_init_image_addon() || !al_init_primitives_addon()) {
-        gameExit("Failed to initialize allegro graphics.");
+    graphicsColor = al_map_rgba(255, 255, 255, 255); 
+    graphicsBackgroundColor = al_map_rgba(0, 0, 0, 255); 
+    graphicsImages = hashMap(0);
+    soundSamples = hashMap(0);
+
+    // Without a display all bitmaps live in memory and there's no
+    // timer, input or audio to set up, drawing is skipped entirely so there's
+    // no need for a target bitmap either
+    if (stateIsHeadless) {
+        al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+        luaLoad();
+        return;
     }
 
     // Init Screen
@@ -139,11 +178,6 @@ void gameLoad() {
         al_set_target_bitmap(al_get_backbuffer(graphicsDisplay));
     }
 
-    graphicsColor = al_map_rgba(255, 255, 255, 255); 
-    graphicsBackgroundColor = al_map_rgba(0, 0, 0, 255); 
-    graphicsImages = hashMap(0);
-    graphicsImageTiles = hashMap(0);
-
 
     // Setup the audio
     if (!al_install_audio()) {
@@ -159,7 +193,6 @@ void gameLoad() {
 
     al_reserve_samples(16);
 	al_init_acodec_addon();
-    soundSamples = hashMap(0);
 
     // API and everything is ready, we can now load stuff
     luaLoad();
@@ -168,14 +201,121 @@ void gameLoad() {
 
 
 // Loop -----------------------------------------------------------------------
-void gameLoop() {
+// Advances the clock by one fixed step, the time is always derived from the
+// tick count so it does not drift no matter how long the game runs
+static void gameAdvanceTick() {
+
+    gameTimeDelta = 0;
+    if (!stateIsPaused) {
+        gameTick++;
+        gameTimeDelta = 1.0 / graphicsFrameRate;
+    }
+
+    gameTimeNs = gameTick * NS_PER_SECOND / graphicsFrameRate;
+    gameTime = (double)gameTimeNs / NS_PER_SECOND;
+
+}
+
+// Runs one update of the game and advances the input states, returns false in
+// case the frame should not be rendered
+static bool gameStep() {
 
-    double lastFrameTime = 0, now = 0;
-    bool redraw = true;
     unsigned int i = 0;
+
+    // Apply or record the input for this step
+    replayBeforeStep();
+
+    // Lua call
+    statsBegin(STATS_UPDATE);
+    luaUpdate();
+    schedStep();
+    statsEnd(STATS_UPDATE);
+
+    // Update / Reset Input States
+    for(i = 0; i < ALLEGRO_KEY_MAX; i++) {
+        if (keyStates[i] == 1) {
+            keyStates[i] = 2;
+        }
+    }
+
+    for(i = 0; i < MAX_MOUSE; i++) {
+        if (mouseStates[i] == 1) {
+            mouseStates[i] = 2;
+        }
+    }
+
+    for(i = 0; i < ALLEGRO_KEY_MAX; i++) {
+        keyStatesOld[i] = keyStates[i];
+    }
+
+    replayAfterStep();
+
+    // Handle hot code reloading
+    if (stateReload) {
+
+        stateReload = false;
+        while(lua_gettop(L)) {
+            lua_pop(L, 1);
+        }
+        luaClearModules();
+        luaRequire("main.lua");
+        lua_pop(L, 1);
+
+        graphicsDirty = true;
+        return false;
+
+    }
+
+    return true;
+
+}
+
+static bool gameIsInputEvent(int type) {
+    switch(type) {
+        case ALLEGRO_EVENT_KEY_DOWN:
+        case ALLEGRO_EVENT_KEY_UP:
+        case ALLEGRO_EVENT_MOUSE_AXES:
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+        case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+        case ALLEGRO_EVENT_MOUSE_ENTER_DISPLAY:
+        case ALLEGRO_EVENT_MOUSE_LEAVE_DISPLAY:
+        case ALLEGRO_EVENT_DISPLAY_SWITCH_IN:
+        case ALLEGRO_EVENT_DISPLAY_SWITCH_OUT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// While paused the screen is only redrawn once something changed or the keep
+// alive interval has passed
+static bool gameNeedsRedraw(double lastRenderTime) {
+
+    if (!stateIsPaused || graphicsDirty || graphicsResized) {
+        return true;
+    }
+
+    return graphicsKeepAlive > 0 && al_get_time() - lastRenderTime >= 1.0 / graphicsKeepAlive;
+
+}
+
+void gameLoop() {
+
+    double lastFrameTime = 0, lastRenderTime = 0, now = 0, step = 0, accumulator = 0;
+    bool redraw = true, collected = true;
+    unsigned int i = 0, steps = 0;
     
     debugLog("game: loop...\n");
+    renderInit(graphicsThreaded);
+
+    // Reload modules as soon as they are saved, bundles can't change
+    #ifndef BUNDLE
+        watchInit(".");
+    #endif
+
 	al_start_timer(stateTimer);
+    lastFrameTime = al_get_time();
 
     stateIsRunning = true;
     while (stateIsRunning) {
@@ -183,7 +323,13 @@ void gameLoop() {
 		ALLEGRO_EVENT event;
 		al_wait_for_event(stateEventQueue, &event);
 
+        // Input is fed from the replay file instead
+        if (replayIsPlaying && gameIsInputEvent(event.type)) {
+            continue;
+        }
+
         // Handle Events
+        statsBegin(STATS_EVENTS);
         switch (event.type) {
             case ALLEGRO_EVENT_DISPLAY_CLOSE:
                 stateIsRunning = false;
@@ -248,115 +394,130 @@ void gameLoop() {
 
             case ALLEGRO_EVENT_TIMER:
 
+                // Pick up changed modules before they are used again
+                watchPoll();
+
                 // Timer
                 now = al_get_time();
-                gameTimeDelta = now - lastFrameTime;
-                if (stateIsPaused) {
-                    gameTimeDelta = 0;
-                }
-
-                gameTime += gameTimeDelta;
+                accumulator += now - lastFrameTime;
                 lastFrameTime = now;
 
-                // Lua call
-                luaUpdate();
+                // Run the updates with a fixed time step so a hitch does
+                // not result in one huge step
+                step = 1.0 / graphicsFrameRate;
+                redraw = true;
+                statsEnd(STATS_EVENTS);
+                for(steps = 0; accumulator >= step && steps < MAX_FRAME_STEPS; steps++) {
 
-                // Update / Reset Input States
-                for(i = 0; i < ALLEGRO_KEY_MAX; i++) {
-                    if (keyStates[i] == 1) {
-                        keyStates[i] = 2;
-                    }
-                }
+                    gameAdvanceTick();
+                    accumulator -= step;
 
-                for(i = 0; i < MAX_MOUSE; i++) {
-                    if (mouseStates[i] == 1) {
-                        mouseStates[i] = 2;
+                    if (!gameStep()) {
+                        redraw = false;
                     }
-                }
 
-                for(i = 0; i < ALLEGRO_KEY_MAX; i++) {
-                    keyStatesOld[i] = keyStates[i];
                 }
 
-                redraw = true;
-                
-                // Handle hot code reloading
-                if (stateReload) {
-
-                    redraw = false;
-                    stateReload = false;
-                    while(lua_gettop(L)) {
-                        lua_pop(L, 1);
-                    }
-                    luaRequire("main.lua");
-                    lua_pop(L, 1);
+                collected = false;
+                statsBegin(STATS_EVENTS);
 
+                // Drop the time we could not catch up on
+                if (accumulator >= step) {
+                    accumulator = 0;
                 }
 
+                // How far we are into the next step, for interpolation
+                gameTimeAlpha = accumulator / step;
                 break;
         
 
             default:
                 break;
         }
+        statsEnd(STATS_EVENTS);
+
+        // Input usually changes what's on screen
+        if (gameIsInputEvent(event.type) || event.type == ALLEGRO_EVENT_DISPLAY_EXPOSE) {
+            graphicsDirty = true;
+        }
 
 
         // Render it out
-		if (redraw && al_is_event_queue_empty(stateEventQueue)) {
+		if (redraw && al_is_event_queue_empty(stateEventQueue) && gameNeedsRedraw(lastRenderTime)) {
 
-            // Handle resizing
-            if (graphicsResized) {
+            // Record the draw calls of this frame
+            statsBegin(STATS_RENDER);
+            renderBegin();
+            luaRender();
+            statsEnd(STATS_RENDER);
 
-                al_resize_display(graphicsDisplay, graphicsWidth * graphicsScale, graphicsHeight * graphicsScale);
+            if (statsOverlay) {
+                statsRender(0, graphicsHeight, 1.0 / graphicsFrameRate);
+            }
 
-                if (graphicsBackground != NULL) {
-                    al_destroy_bitmap(graphicsBackground);
-                }
+            // Draw them out, either right away or on the render thread
+            renderEnd();
 
-                if (graphicsScale != 1) {
-                    graphicsBackground = al_create_bitmap(graphicsWidth, graphicsHeight);
-                    al_set_target_bitmap(graphicsBackground);
+            // Collect garbage with whatever is left of this frame
+            if (!collected) {
+                statsBegin(STATS_GC);
+                luaCollect(step - (al_get_time() - now));
+                statsEnd(STATS_GC);
+                collected = true;
+            }
 
-                } else {
-                    al_set_target_bitmap(al_get_backbuffer(graphicsDisplay));
-                }
+            statsNextFrame();
+            poolNextFrame(&luaPool);
+            lastRenderTime = al_get_time();
+            graphicsDirty = false;
+            redraw = false;
 
-                graphicsResized = false;
+        }
 
-            }
+        // Ticks which draw nothing still have to collect, e.g. while paused
+        // or when the event queue never runs empty
+        if (event.type == ALLEGRO_EVENT_TIMER && !collected) {
+            statsBegin(STATS_GC);
+            luaCollect(step - (al_get_time() - now));
+            statsEnd(STATS_GC);
+            collected = true;
+        }
 
-            if (graphicsScale != 1) {
-                al_set_target_bitmap(graphicsBackground);
-            }
+    }
 
-            al_clear_to_color(graphicsBackgroundColor);
+}
 
-            // Lua call
-            //al_hold_bitmap_drawing(true);
-            luaRender();
-            //al_hold_bitmap_drawing(false);
+// Steps the game as fast as possible with a fixed time delta, nothing gets
+// rendered and there's no input
+void gameLoopHeadless(unsigned int ticks) {
 
-            // Scale up if necessary
-            if (graphicsScale != 1) {
-                al_set_target_bitmap(al_get_backbuffer(graphicsDisplay));
-                al_draw_scaled_bitmap(graphicsBackground, 0, 0, graphicsWidth, graphicsHeight, 0, 0, 
-                                      graphicsWidth * graphicsScale, graphicsHeight * graphicsScale, 0);
-            }
+    unsigned int i = 0;
+    double start = 0;
 
-			al_flip_display();
-            redraw = false;
+    debugLog("game: headless loop (%u ticks)...\n", ticks);
+    start = al_get_time();
 
-        }
+    stateIsRunning = true;
+    for(i = 0; i < ticks && stateIsRunning; i++) {
+
+        gameAdvanceTick();
+        gameStep();
+
+        statsBegin(STATS_GC);
+        luaCollect(1.0 / graphicsFrameRate);
+        statsEnd(STATS_GC);
+
+        statsNextFrame();
+        poolNextFrame(&luaPool);
 
     }
 
-}
+    debugLog("game: %u ticks in %.3f seconds\n", i, al_get_time() - start);
 
-void clearImage(const char *key, void *value) {
-    al_destroy_bitmap(value);
 }
 
-void clearImageTile(const char *key, void *value) {
+void clearImage(const char *key, void *value) {
+    al_destroy_bitmap(((Image*)value)->bitmap);
     free(value);
 }
 
@@ -364,9 +525,20 @@ void gameCleanup() {
     
     debugLog("game: cleanup...\n");
 
-	al_destroy_event_queue(stateEventQueue);
-	al_destroy_timer(stateTimer);
-	al_destroy_display(graphicsDisplay);
+    renderCleanup();
+    watchCleanup();
+
+    if (stateEventQueue != NULL) {
+	    al_destroy_event_queue(stateEventQueue);
+    }
+
+    if (stateTimer != NULL) {
+	    al_destroy_timer(stateTimer);
+    }
+
+    if (graphicsDisplay != NULL) {
+	    al_destroy_display(graphicsDisplay);
+    }
 
     if (graphicsBackground != NULL) {
         al_destroy_bitmap(graphicsBackground);
@@ -376,11 +548,7 @@ void gameCleanup() {
     graphicsImages->each(graphicsImages, *clearImage);
     graphicsImages->destroy(&graphicsImages);
 
-    // Free image tiles
-    graphicsImageTiles->each(graphicsImageTiles, *clearImageTile);
-    graphicsImageTiles->destroy(&graphicsImageTiles);
-
-    ioCloseBundle();
+    replayClose();
 
 }
 
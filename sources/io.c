@@ -23,9 +23,14 @@
 
 unzFile *zipFile = NULL;
 
+// The bundle has a single read position, so instances running on other
+// threads have to take turns
+static ALLEGRO_MUTEX *zipMutex = NULL;
+
 void ioOpenBundle(const char *filename) {
     
     debugLog("bundle: open \"%s\"...\n", filename);
+    zipMutex = al_create_mutex();
     zipFile = unzOpen(filename);
     if (zipFile == NULL) {
         debugLog("bundle: Failed to open\n");
@@ -36,75 +41,98 @@ void ioOpenBundle(const char *filename) {
 void ioCloseBundle() {
     if (zipFile) {
         unzClose(zipFile);
+        zipFile = NULL;
+    }
+
+    if (zipMutex) {
+        al_destroy_mutex(zipMutex);
+        zipMutex = NULL;
     }
 }
 
-char *ioLoadResource(const char *filename, unsigned int *bufSize) {
-    
-    // We assume the chdir to "game" has been done already
-    if (zipFile == NULL) {
+static char *ioLoadBundleResource(const char *filename, unsigned int *bufSize) {
 
-        FILE *f = fopen(filename, "r");
-        char *buf;
+    if (unzLocateFile(zipFile, filename, 0) != UNZ_OK) {
+        debugLog("io: File \"%s\" not found in bundle\n", filename);
+        return NULL;
 
-        if (f == NULL) {
-            debugLog("io: File \"%s\" not found\n", filename);
-            return NULL;
-        }
+    } else {
 
-        fseek(f, 0, SEEK_END);
-        *bufSize = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        
-        buf = (char*)calloc(*bufSize + 1, sizeof(char));
-        if (fread(buf, sizeof(char), *bufSize, f) != *bufSize) {
-            debugLog("io: File \"%s\" could not be read\n", filename);
+        if (unzOpenCurrentFile(zipFile) != UNZ_OK) {
+            debugLog("io: Failed to open \"%s\" in bundle\n", filename);
             return NULL;
+            
+        } else {
+
+            unz_file_info file_info;
+            char filename_inzip[256];
+            int err = unzGetCurrentFileInfo(zipFile, &file_info, filename_inzip,sizeof(filename_inzip),NULL,0,NULL,0);
+            char *buf;
+
+            if (err != UNZ_OK) {
+                debugLog("io: Failed to get info on \"%s\" in bundle\n", filename);
+                return NULL;
+            }
+
+            *bufSize = file_info.uncompressed_size;
+            buf = (char*)calloc(*bufSize + 1, sizeof(char));
+            unzReadCurrentFile(zipFile, buf, *bufSize);
+
+            unzCloseCurrentFile(zipFile);
+
+            debugLog("io: File \"%s\" loaded from bundle\n", filename);
+
+            return buf;
+
         }
-        fclose(f);
 
-        debugLog("io: File \"%s\" loaded\n", filename);
-        return buf;
+    }
 
-    } else {
-        
-        if (unzLocateFile(zipFile, filename, 0) != UNZ_OK) {
-            debugLog("io: File \"%s\" not found in bundle\n", filename);
-            return NULL;
+}
 
-        } else {
+static char *ioLoadFileResource(const char *filename, unsigned int *bufSize) {
 
-            if (unzOpenCurrentFile(zipFile) != UNZ_OK) {
-                debugLog("io: Failed to open \"%s\" in bundle\n", filename);
-                return NULL;
-                
-            } else {
+    // We assume the chdir to "game" has been done already
+    FILE *f = fopen(filename, "r");
+    char *buf;
 
-                unz_file_info file_info;
-                char filename_inzip[256];
-                int err = unzGetCurrentFileInfo(zipFile, &file_info, filename_inzip,sizeof(filename_inzip),NULL,0,NULL,0);
-                char *buf;
+    if (f == NULL) {
+        debugLog("io: File \"%s\" not found\n", filename);
+        return NULL;
+    }
 
-                if (err != UNZ_OK) {
-                    debugLog("io: Failed to get info on \"%s\" in bundle\n", filename);
-                    return NULL;
-                }
+    fseek(f, 0, SEEK_END);
+    *bufSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    buf = (char*)calloc(*bufSize + 1, sizeof(char));
+    if (fread(buf, sizeof(char), *bufSize, f) != *bufSize) {
+        debugLog("io: File \"%s\" could not be read\n", filename);
+        return NULL;
+    }
+    fclose(f);
 
-                *bufSize = file_info.uncompressed_size;
-                buf = (char*)calloc(*bufSize + 1, sizeof(char));
-                unzReadCurrentFile(zipFile, buf, *bufSize);
+    debugLog("io: File \"%s\" loaded\n", filename);
+    return buf;
 
-                unzCloseCurrentFile(zipFile);
+}
 
-                debugLog("io: File \"%s\" loaded from bundle\n", filename);
+char *ioLoadResource(const char *filename, unsigned int *bufSize) {
 
-                return buf;
+    char *buf;
 
-            }
+    traceBegin("ioLoadResource");
+    if (zipFile == NULL) {
+        buf = ioLoadFileResource(filename, bufSize);
 
-        }
-        
+    } else {
+        al_lock_mutex(zipMutex);
+        buf = ioLoadBundleResource(filename, bufSize);
+        al_unlock_mutex(zipMutex);
     }
+    traceEnd("ioLoadResource");
+
+    return buf;
 
 }
 
@@ -122,6 +150,7 @@ ALLEGRO_BITMAP *ioLoadBitmap(const char *filename) {
     ALLEGRO_BITMAP *img = NULL;
 
     debugLog("io: load bitmap \"%s\"\n", filename);
+    traceBegin("ioLoadBitmap");
 
     len = strlen(filename);
     ext = (char*)calloc(5, sizeof(char));
@@ -132,6 +161,7 @@ ALLEGRO_BITMAP *ioLoadBitmap(const char *filename) {
 
     free(ext);
 
+    traceEnd("ioLoadBitmap");
     debugLog("io: bitmap \"%s\" loaded\n", filename);
 
     return img;
@@ -145,6 +175,7 @@ ALLEGRO_SAMPLE *ioLoadSample(const char *filename) {
     ALLEGRO_SAMPLE *smp = NULL;
 
     debugLog("io: load sample \"%s\"\n", filename);
+    traceBegin("ioLoadSample");
 
     len = strlen(filename);
     ext = (char*)calloc(5, sizeof(char));
@@ -155,6 +186,7 @@ ALLEGRO_SAMPLE *ioLoadSample(const char *filename) {
 
     free(ext);
 
+    traceEnd("ioLoadSample");
     debugLog("io: sample \"%s\" loaded\n", filename);
 
     return smp;
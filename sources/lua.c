@@ -27,21 +27,29 @@ extern const int defaultWidth;
 extern const int defaultHeight;
 extern const int defaultScale;
 extern const int defaultFrameRate;
+extern const int defaultKeepAlive;
 
-extern double gameTime;
-extern double gameTimeDelta;
+extern THREAD_LOCAL double gameTime;
+extern THREAD_LOCAL double gameTimeDelta;
+extern THREAD_LOCAL double gameTimeAlpha;
 
-extern const char* graphicsTitle;
-extern int graphicsWidth;
-extern int graphicsHeight;
-extern int graphicsScale;
-extern int graphicsFrameRate;
+extern THREAD_LOCAL const char* graphicsTitle;
+extern THREAD_LOCAL int graphicsWidth;
+extern THREAD_LOCAL int graphicsHeight;
+extern THREAD_LOCAL int graphicsScale;
+extern THREAD_LOCAL int graphicsFrameRate;
+extern bool graphicsThreaded;
+extern THREAD_LOCAL int graphicsKeepAlive;
 
 
 // Lua 
+THREAD_LOCAL lua_State *L = NULL;
+THREAD_LOCAL Pool luaPool;
+
 void luaCheckGameFunction(const char *name);
 const char *luaGetGameConfigString(const char *name);
 int luaGetGameConfigInteger(const char *name);
+bool luaGetGameConfigBoolean(const char *name);
 
 int luaEmptyFunction(lua_State *L) {
     return 0;
@@ -55,31 +63,294 @@ bool luax_optboolean(lua_State * L, int idx, bool b) {
 }
 
 
+#ifdef BUNDLE
+static char *luaLoadCompiled(const char *filename, unsigned int *len) {
+
+    char *buf;
+    char *compiled = (char*)calloc(strlen(filename) + 2, sizeof(char));
+    strcat(compiled, filename);
+    strcat(compiled, "c");
+
+    buf = ioLoadResource(compiled, len);
+    free(compiled);
+
+    if (buf == NULL) {
+        buf = ioLoadResource(filename, len);
+    }
+
+    return buf;
+
+}
+#endif
+
 // Works somehow like require, but is able to load files from a zip bundle if possible
-// leaves the function on the stack
-void luaRequire(const char *filename) {
+// leaves the return value of the module on the stack, or nil if it failed
+bool luaRequire(const char *filename) {
 
     char *buf;
     unsigned int len;
+    bool loaded = false;
 
     debugLog("lua: require \"%s\"\n", filename);
-
-    buf = ioLoadResource(filename, &len);
+    traceBegin("luaRequire");
+
+    // Bundles come with precompiled modules next to the sources
+    #ifdef BUNDLE
+        buf = luaLoadCompiled(filename, &len);
+    #else
+        buf = ioLoadResource(filename, &len);
+    #endif
     if (buf != NULL) {
-        luaL_loadbuffer(L, buf, len, filename);
-        lua_pcall(L, 0, 1, 0); // this will leave return value of the module on the stack
+
+        if (luaL_loadbuffer(L, buf, len, filename) || lua_pcall(L, 0, 1, 0)) {
+            luaError();
+            lua_pop(L, 2);
+            lua_pushnil(L);
+
+        } else {
+            loaded = true;
+        }
+
         free(buf);
+
+    } else {
+        lua_pushnil(L);
     }
 
+    traceEnd("luaRequire");
+    return loaded;
+
 }
 
+// Modules are only loaded once and then kept in package.loaded, the names
+// are tracked separately so a reload can throw away just the game's modules
 int luax_require(lua_State *L) {
-    const char *filename = luaL_checkstring(L, 1);
-    char *str = (char*)calloc(strlen(filename) + 5, sizeof(char));
-    strcat(str, filename);
+
+    const char *name = luaL_checkstring(L, 1);
+    char *str;
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaded");
+    lua_getfield(L, -1, name);
+    if (!lua_isnil(L, -1)) {
+        return 1;
+    }
+    lua_pop(L, 1);
+
+    str = (char*)calloc(strlen(name) + 5, sizeof(char));
+    strcat(str, name);
     strcat(str, ".lua");
-    luaRequire(str);
+
+    if (luaRequire(str)) {
+
+        // Modules without a return value are still marked as loaded
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            lua_pushboolean(L, true);
+        }
+
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, name);
+
+        lua_getfield(L, LUA_REGISTRYINDEX, "kuusi.modules");
+        lua_pushboolean(L, true);
+        lua_setfield(L, -2, name);
+        lua_pop(L, 1);
+
+    }
+
+    free(str);
     return 1;
+
+}
+
+// Drops all cached modules so the next require loads them again
+void luaClearModules() {
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaded");
+    lua_getfield(L, LUA_REGISTRYINDEX, "kuusi.modules");
+
+    lua_pushnil(L);
+    while(lua_next(L, -2)) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_pushnil(L);
+        lua_settable(L, -5);
+    }
+
+    lua_pop(L, 3);
+
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, "kuusi.modules");
+
+}
+
+// Hot Reload -----------------------------------------------------------------
+// Classes are cached by class.lua, so running a module again already
+// redefines the methods on the existing class tables. Subclasses however got
+// a copy of their base's methods, these copies are updated here as long as
+// the subclass did not override them.
+static bool luaIsDerived(int sub, int cls) {
+
+    bool derived = false;
+
+    lua_pushvalue(L, sub);
+    while(!derived) {
+
+        lua_getfield(L, -1, "_base");
+        lua_remove(L, -2);
+        if (!lua_istable(L, -1)) {
+            break;
+        }
+
+        derived = lua_rawequal(L, -1, cls);
+
+    }
+
+    lua_pop(L, 1);
+    return derived;
+
+}
+
+static void luaPatchClass(int classes, int cls, int snapshot) {
+
+    lua_pushnil(L);
+    while(lua_next(L, cls)) {
+
+        // Compare against the value before the reload
+        lua_pushvalue(L, -2);
+        lua_rawget(L, snapshot);
+
+        if (!lua_rawequal(L, -1, -2)) {
+
+            lua_pushnil(L);
+            while(lua_next(L, classes)) {
+
+                if (lua_istable(L, -1) && !lua_rawequal(L, -1, cls) 
+                    && luaIsDerived(lua_gettop(L), cls)) {
+
+                    // Still the inherited value?
+                    lua_pushvalue(L, -5);
+                    lua_rawget(L, -2);
+                    if (lua_rawequal(L, -1, -4)) {
+                        lua_pushvalue(L, -6);
+                        lua_pushvalue(L, -6);
+                        lua_rawset(L, -4);
+                    }
+                    lua_pop(L, 1);
+
+                }
+
+                lua_pop(L, 1);
+
+            }
+
+        }
+
+        lua_pop(L, 2);
+
+    }
+
+}
+
+// Runs a single module again and patches its classes in place, the state of
+// the game is left untouched
+void luaReloadModule(const char *name) {
+
+    int base = lua_gettop(L);
+    int classes, snapshots, loaded, old;
+
+    // Only modules which went through require can be reloaded on their own
+    lua_getfield(L, LUA_REGISTRYINDEX, "kuusi.modules");
+    lua_getfield(L, -1, name);
+    if (lua_isnil(L, -1)) {
+        lua_settop(L, base);
+        return;
+    }
+    lua_settop(L, base);
+
+    debugLog("lua: reload module \"%s\"...\n", name);
+
+    lua_getglobal(L, "__class_cache");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+    }
+    classes = lua_gettop(L);
+
+    // Remember all classes as they are now
+    lua_newtable(L);
+    snapshots = lua_gettop(L);
+
+    lua_pushnil(L);
+    while(lua_next(L, classes)) {
+
+        if (lua_istable(L, -1)) {
+
+            lua_pushvalue(L, -1);
+            lua_newtable(L);
+
+            lua_pushnil(L);
+            while(lua_next(L, -4)) {
+                lua_pushvalue(L, -2);
+                lua_insert(L, -2);
+                lua_rawset(L, -4);
+            }
+
+            lua_rawset(L, snapshots);
+
+        }
+
+        lua_pop(L, 1);
+
+    }
+
+    // Require it again
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaded");
+    loaded = lua_gettop(L);
+    lua_getfield(L, loaded, name);
+    old = lua_gettop(L);
+
+    lua_pushnil(L);
+    lua_setfield(L, loaded, name);
+
+    lua_getglobal(L, "require");
+    lua_pushstring(L, name);
+    if (lua_pcall(L, 1, 1, 0)) {
+        luaError();
+        lua_pushvalue(L, old);
+        lua_setfield(L, loaded, name);
+        lua_settop(L, base);
+        return;
+    }
+
+    // Tables returned by the module are updated in place, so references
+    // to them stay valid
+    if (lua_istable(L, old) && lua_istable(L, -1) && !lua_rawequal(L, old, -1)) {
+
+        lua_pushnil(L);
+        while(lua_next(L, -2)) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, old);
+        }
+
+        lua_pushvalue(L, old);
+        lua_setfield(L, loaded, name);
+
+    }
+
+    // Now hand down the changed methods
+    lua_pushnil(L);
+    while(lua_next(L, snapshots)) {
+        luaPatchClass(classes, lua_gettop(L) - 1, lua_gettop(L));
+        lua_pop(L, 1);
+    }
+
+    lua_settop(L, base);
+
 }
 
 void luaError() {
@@ -94,6 +365,214 @@ void luaError() {
 
 }
 
+// Hooks ----------------------------------------------------------------------
+// The watchdog and the profiler share a single count hook which runs every
+// thousand instructions during game.update and game.render, the profiler
+// only takes a sample once per PROFILE_INTERVAL though
+#define HOOK_INSTRUCTIONS 1000
+#define PROFILE_DEPTH 32
+#define PROFILE_STACK 1024
+#define PROFILE_INTERVAL 0.001
+
+static THREAD_LOCAL double luaBudget = 0;
+static THREAD_LOCAL bool luaBudgetAbort = false;
+static THREAD_LOCAL double luaBudgetStart = 0;
+static THREAD_LOCAL bool luaBudgetExceeded = false;
+
+static THREAD_LOCAL HashMap *luaProfileStacks = NULL;
+static THREAD_LOCAL FILE *luaProfileFile = NULL;
+static THREAD_LOCAL double luaProfileNext = 0;
+
+// Counts the current stack in folded form, outermost frame first
+static void luaProfileSample(lua_State *L) {
+
+    lua_Debug frames[PROFILE_DEPTH];
+    char stack[PROFILE_STACK];
+    int depth, i, len = 0;
+    unsigned long *count;
+
+    for(depth = 0; depth < PROFILE_DEPTH && lua_getstack(L, depth, &frames[depth]); depth++) {
+        lua_getinfo(L, "Sn", &frames[depth]);
+    }
+
+    stack[0] = '\0';
+    for(i = depth - 1; i >= 0 && len < PROFILE_STACK; i--) {
+        len += snprintf(stack + len, PROFILE_STACK - len, "%s%s@%s:%d", 
+                        i == depth - 1 ? "" : ";",
+                        frames[i].name != NULL ? frames[i].name : frames[i].what,
+                        frames[i].short_src, frames[i].linedefined);
+    }
+
+    count = (unsigned long*)luaProfileStacks->get(luaProfileStacks, stack);
+    if (count == NULL) {
+        count = (unsigned long*)calloc(1, sizeof(unsigned long));
+        luaProfileStacks->set(luaProfileStacks, stack, count);
+    }
+    (*count)++;
+
+}
+
+static void luaProfileWrite(const char *key, void *value) {
+    fprintf(luaProfileFile, "%s %lu\n", key, *(unsigned long*)value);
+    free(value);
+}
+
+static void luaProfileFree(const char *key, void *value) {
+    free(value);
+}
+
+static void luaWatchdogCheck(lua_State *L) {
+
+    if (luaBudgetExceeded || al_get_time() - luaBudgetStart <= luaBudget) {
+        return;
+    }
+
+    luaBudgetExceeded = true;
+    statsOverrun();
+
+    // L might be a task's thread, so this can't go through luaError
+    luaL_traceback(L, L, NULL, 0);
+    debugLog("%s\n - frame budget of %f ms exceeded\n", lua_tostring(L, -1), luaBudget * 1000);
+    lua_pop(L, 1);
+
+    if (luaBudgetAbort) {
+        luaL_error(L, "aborted after exceeding the frame budget");
+    }
+
+}
+
+static void luaHook(lua_State *L, lua_Debug *ar) {
+
+    double now;
+
+    if (luaProfileStacks != NULL) {
+        now = al_get_time();
+        if (now >= luaProfileNext) {
+            luaProfileNext = now + PROFILE_INTERVAL;
+            luaProfileSample(L);
+        }
+    }
+
+    if (luaBudget > 0) {
+        luaWatchdogCheck(L);
+    }
+
+}
+
+static void luaHookStart() {
+
+    if (luaBudget > 0) {
+        luaBudgetStart = al_get_time();
+        luaBudgetExceeded = false;
+    }
+
+    if (luaBudget > 0 || luaProfileStacks != NULL) {
+        lua_sethook(L, luaHook, LUA_MASKCOUNT, HOOK_INSTRUCTIONS);
+    }
+
+}
+
+static void luaHookStop() {
+    lua_sethook(L, NULL, 0, 0);
+}
+
+// Threads copy the hook that was active when they were created, tasks are
+// resumed outside of luaHookStart and luaHookStop so they set it themselves
+// and count against the budget of the update before them
+void luaHookThread(lua_State *co) {
+
+    if (luaBudget > 0 || luaProfileStacks != NULL) {
+        lua_sethook(co, luaHook, LUA_MASKCOUNT, HOOK_INSTRUCTIONS);
+
+    } else {
+        lua_sethook(co, NULL, 0, 0);
+    }
+
+}
+
+// A budget of 0 disables the watchdog
+void luaSetBudget(double seconds, bool abort) {
+    luaBudget = seconds;
+    luaBudgetAbort = abort;
+}
+
+// Garbage Collection ---------------------------------------------------------
+// With a budget the collector no longer runs on its own, instead it is
+// stepped at the end of each frame in the time that is left over
+#define GC_STEP_KB 16
+
+static THREAD_LOCAL double luaGCBudget = 0;
+
+// A budget of 0 leaves collection to Lua again
+void luaSetGCBudget(double seconds) {
+
+    luaGCBudget = seconds;
+    if (luaGCBudget > 0) {
+        lua_gc(L, LUA_GCSTOP, 0);
+
+    } else {
+        lua_gc(L, LUA_GCRESTART, 0);
+    }
+
+}
+
+// Always does at least one step so memory can't grow without bounds when
+// frames run late
+void luaCollect(double available) {
+
+    double start, slice;
+
+    if (luaGCBudget <= 0) {
+        return;
+    }
+
+    slice = available < luaGCBudget ? available : luaGCBudget;
+    start = al_get_time();
+
+    do {
+        
+        // Stop once a cycle is complete, there's nothing left to do
+        if (lua_gc(L, LUA_GCSTEP, GC_STEP_KB)) {
+            break;
+        }
+
+    } while(al_get_time() - start < slice);
+
+}
+
+void luaProfileStart() {
+    if (luaProfileStacks == NULL) {
+        debugLog("lua: profiling...\n");
+        luaProfileStacks = hashMap(0);
+    }
+}
+
+// Writes the sampled stacks in the folded format flamegraph tools expect,
+// one stack per line followed by its sample count
+bool luaProfileStop(const char *filename) {
+
+    if (luaProfileStacks == NULL) {
+        return false;
+    }
+
+    luaProfileFile = fopen(filename, "w");
+    if (luaProfileFile == NULL) {
+        debugLog("lua: failed to open \"%s\"\n", filename);
+        luaProfileStacks->each(luaProfileStacks, *luaProfileFree);
+
+    } else {
+        luaProfileStacks->each(luaProfileStacks, *luaProfileWrite);
+        fclose(luaProfileFile);
+        luaProfileFile = NULL;
+        debugLog("lua: profile written to \"%s\"\n", filename);
+    }
+
+    luaProfileStacks->destroy(&luaProfileStacks);
+    luaProfileStacks = NULL;
+    return true;
+
+}
+
 int luaReload(lua_State *L) {
     stateReload = true;
     return 0;
@@ -146,6 +625,12 @@ void luaAPI() {
     lua_pushstring(L, defaultTitle);
     lua_setfield(L, -2, "title");
 
+    lua_pushboolean(L, false);
+    lua_setfield(L, -2, "threaded");
+
+    lua_pushinteger(L, defaultKeepAlive);
+    lua_setfield(L, -2, "keepalive");
+
     lua_newtable(L);
     lua_setglobal(L, "keyboard");
 
@@ -166,24 +651,56 @@ void luaAPI() {
 
 }
 
+static int luaPanic(lua_State *L) {
+    debugLog("FATAL: unprotected error in lua code: %s\n", lua_tostring(L, -1));
+    exit(1);
+    return 0;
+}
+
+// Creates a state for the current thread with the standard libraries, the
+// native modules and the patched require, but without the game API
+lua_State *luaNewState() {
+
+    lua_State *state = lua_newstate(poolAlloc, &luaPool);
+    if (state == NULL) {
+        return NULL;
+    }
+
+    lua_atpanic(state, luaPanic);
+    luaL_openlibs(state);
+
+    vecInit(state);
+    setInit(state);
+    dataInit(state);
+
+    // Patch require
+    lua_newtable(state);
+    lua_setfield(state, LUA_REGISTRYINDEX, "kuusi.modules");
+
+    lua_getglobal(state, "_G");
+    lua_pushcfunction(state, luax_require);
+    lua_setfield(state, -2, "require");
+    lua_pop(state, 1);
+
+    return state;
+
+}
+
 void luaInit() {
 
     debugLog("lua: init...\n");
 
     // Create lua state and load game file
-    L = luaL_newstate();
-    luaL_openlibs(L);
+    L = luaNewState();
+    if (L == NULL) {
+        gameExit("Failed to create lua state.");
+    }
 
     luaAPI();
+    workerInit(L);
 
     debugLog("lua: main...\n");
 
-    // Patch require
-    lua_getglobal(L, "_G");
-    lua_pushcfunction(L, luax_require);
-    lua_setfield(L, -2, "require");
-    lua_pop(L, 1);
-
     // Require and pop the returned table
     luaRequire("main.lua");
     lua_pop(L, 1);
@@ -215,6 +732,8 @@ void luaInit() {
     graphicsHeight = luaGetGameConfigInteger("height");
     graphicsScale = luaGetGameConfigInteger("scale");
     graphicsFrameRate = luaGetGameConfigInteger("fps");
+    graphicsThreaded = luaGetGameConfigBoolean("threaded");
+    graphicsKeepAlive = luaGetGameConfigInteger("keepalive");
 
     if (graphicsWidth * graphicsScale <= 0 || graphicsWidth >= 1024 * graphicsScale) {
         gameExit("Invalid width.");
@@ -241,26 +760,37 @@ void luaLoad() {
 
 void luaUpdate() {
 
+    traceBegin("luaUpdate");
     lua_getglobal(L, "game");
     lua_getfield(L, -1, "update");
     lua_pushnumber(L, gameTimeDelta);
     lua_pushnumber(L, gameTime);
+
+    luaHookStart();
     if (lua_pcall(L, 2, 0, 0)) {
         luaError();
     }
+    luaHookStop();
     lua_pop(L, 1);
+    traceEnd("luaUpdate");
 
 }
 
 void luaRender() {
 
+    traceBegin("luaRender");
     lua_getglobal(L, "game");
     lua_getfield(L, -1, "render");
-    if (lua_pcall(L, 0, 0, 0)) {
+    lua_pushnumber(L, gameTimeAlpha);
+
+    luaHookStart();
+    if (lua_pcall(L, 1, 0, 0)) {
         luaError();
     }
+    luaHookStop();
 
     lua_pop(L, 1);
+    traceEnd("luaRender");
 
 }
 
@@ -273,7 +803,46 @@ void luaCleanup() {
     lua_call(L, 0, 0);
     lua_pop(L, 1);
 
+    // Don't lose a profile that is still running
+    luaProfileStop("profile.folded");
+
+    schedCleanup();
     lua_close(L);
+    poolDestroy(&luaPool);
+
+}
+
+
+// Compiler -------------------------------------------------------------------
+static int luaCompileWriter(lua_State *L, const void *p, size_t size, void *ud) {
+    return fwrite(p, 1, size, (FILE*)ud) != size;
+}
+
+// Compiles a module to bytecode, used when building the bundle
+bool luaCompile(const char *source, const char *target) {
+
+    FILE *fp;
+    bool compiled;
+    lua_State *C = luaL_newstate();
+
+    if (luaL_loadfile(C, source)) {
+        debugLog("lua: failed to compile \"%s\": %s\n", source, lua_tostring(C, -1));
+        lua_close(C);
+        return false;
+    }
+
+    fp = fopen(target, "wb");
+    if (fp == NULL) {
+        debugLog("lua: failed to open \"%s\"\n", target);
+        lua_close(C);
+        return false;
+    }
+
+    compiled = lua_dump(C, luaCompileWriter, fp) == 0;
+    fclose(fp);
+    lua_close(C);
+
+    return compiled;
 
 }
 
@@ -324,3 +893,17 @@ int luaGetGameConfigInteger(const char *name) {
 
 }
 
+bool luaGetGameConfigBoolean(const char *name) {
+
+    bool value;
+    lua_getglobal(L, "game");
+    lua_getfield(L, -1, "conf");
+    lua_getfield(L, -1, name);
+
+    value = lua_toboolean(L, -1);
+    lua_pop(L, 3);
+
+    return value;
+
+}
+
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/pool.h"
+
+// Size classes ---------------------------------------------------------------
+static unsigned int poolClass(size_t size) {
+    return (size + POOL_GRANULARITY - 1) / POOL_GRANULARITY - 1;
+}
+
+static void *poolTake(Pool *pool, size_t size) {
+
+    unsigned int c = poolClass(size);
+    size_t blockSize = (c + 1) * POOL_GRANULARITY;
+    PoolBlock *block = pool->free[c];
+    PoolSlab *slab;
+
+    pool->frame.classAllocs[c]++;
+
+    if (block != NULL) {
+        pool->free[c] = block->next;
+        return block;
+    }
+
+    // Carve a new block from the current slab, what is left of the slab
+    // when it runs out is simply given up
+    if (pool->slabLeft < blockSize) {
+
+        slab = (PoolSlab*)malloc(POOL_SLAB_SIZE);
+        if (slab == NULL) {
+            return NULL;
+        }
+
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->slabPos = (char*)slab + POOL_GRANULARITY;
+        pool->slabLeft = POOL_SLAB_SIZE - POOL_GRANULARITY;
+        pool->reserved += POOL_SLAB_SIZE;
+
+    }
+
+    block = (PoolBlock*)pool->slabPos;
+    pool->slabPos += blockSize;
+    pool->slabLeft -= blockSize;
+    return block;
+
+}
+
+// Turns a system block into a slab holding a single pool block, so that it
+// can be handed out for a smaller class and is still released with free
+static void *poolAdopt(Pool *pool, void *ptr, size_t osize, size_t nsize) {
+
+    size_t size = POOL_GRANULARITY + (poolClass(nsize) + 1) * POOL_GRANULARITY;
+    PoolSlab *slab = (PoolSlab*)ptr;
+
+    if (osize < size) {
+        slab = (PoolSlab*)realloc(ptr, size);
+        if (slab == NULL) {
+            return NULL;
+        }
+        osize = size;
+    }
+
+    memmove((char*)slab + POOL_GRANULARITY, slab, nsize);
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->reserved += osize;
+
+    return (char*)slab + POOL_GRANULARITY;
+
+}
+
+static void poolGive(Pool *pool, void *ptr, size_t size) {
+    unsigned int c = poolClass(size);
+    PoolBlock *block = (PoolBlock*)ptr;
+    block->next = pool->free[c];
+    pool->free[c] = block;
+}
+
+
+// Allocator ------------------------------------------------------------------
+// Used as the lua_Alloc of a state with the pool as its userdata
+void *poolAlloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+
+    Pool *pool = (Pool*)ud;
+    void *block;
+
+    // For new blocks Lua passes the object type in osize
+    if (ptr == NULL) {
+        osize = 0;
+    }
+
+    if (nsize == 0) {
+
+        if (ptr != NULL) {
+
+            if (osize <= POOL_MAX_SIZE) {
+                poolGive(pool, ptr, osize);
+
+            } else {
+                free(ptr);
+            }
+
+            pool->used -= osize;
+            pool->frame.frees++;
+
+        }
+
+        return NULL;
+
+    }
+
+    // Resizes within the same class stay where they are
+    if (ptr != NULL && osize <= POOL_MAX_SIZE && nsize <= POOL_MAX_SIZE 
+        && poolClass(osize) == poolClass(nsize)) {
+
+        pool->used += nsize - osize;
+        return ptr;
+
+    }
+
+    // Big blocks can be resized by the system
+    if (ptr != NULL && osize > POOL_MAX_SIZE && nsize > POOL_MAX_SIZE) {
+        
+        block = realloc(ptr, nsize);
+        if (block == NULL && nsize > osize) {
+            return NULL;
+
+        } else if (block == NULL) {
+            block = ptr;
+        }
+
+    } else {
+
+        if (nsize <= POOL_MAX_SIZE) {
+            block = poolTake(pool, nsize);
+
+        } else {
+            pool->frame.classAllocs[POOL_CLASSES]++;
+            block = malloc(nsize);
+        }
+
+        // Lua expects shrinking to always work, the old block is still big
+        // enough and ends up in the smaller class once it is freed, system
+        // blocks become slabs of their own so they are released with free
+        if (block == NULL && ptr != NULL && nsize <= osize) {
+
+            if (osize > POOL_MAX_SIZE) {
+                ptr = poolAdopt(pool, ptr, osize, nsize);
+                if (ptr == NULL) {
+                    return NULL;
+                }
+            }
+
+            pool->used += nsize - osize;
+            return ptr;
+
+        } else if (block == NULL) {
+            return NULL;
+        }
+
+        if (ptr != NULL) {
+
+            memcpy(block, ptr, osize < nsize ? osize : nsize);
+            if (osize <= POOL_MAX_SIZE) {
+                poolGive(pool, ptr, osize);
+
+            } else {
+                free(ptr);
+            }
+
+        }
+
+    }
+
+    pool->used += nsize - osize;
+    pool->frame.allocs++;
+    pool->frame.bytes += nsize;
+    return block;
+
+}
+
+
+// Stats ----------------------------------------------------------------------
+void poolNextFrame(Pool *pool) {
+    pool->last = pool->frame;
+    memset(&pool->frame, 0, sizeof(PoolStats));
+}
+
+// Frees all slabs, only valid once the Lua state using the pool is closed
+void poolDestroy(Pool *pool) {
+
+    PoolSlab *slab;
+
+    while(pool->slabs != NULL) {
+        slab = pool->slabs;
+        pool->slabs = slab->next;
+        free(slab);
+    }
+
+    memset(pool, 0, sizeof(Pool));
+
+}
+
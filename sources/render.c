@@ -0,0 +1,389 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/render.h"
+
+#define RENDER_BUFFER_MIN_SIZE 256
+
+// Lua records into one buffer while the other one gets drawn
+static RenderBuffer renderBuffers[2];
+static RenderBuffer *renderRecording = &renderBuffers[0];
+
+// Threading
+static bool renderThreaded = false;
+static ALLEGRO_THREAD *renderThread = NULL;
+static ALLEGRO_MUTEX *renderMutex = NULL;
+static ALLEGRO_COND *renderCond = NULL;
+static RenderBuffer *renderPending = NULL;
+
+
+// Recording ------------------------------------------------------------------
+static RenderCommand *renderAppend(RenderType type, ALLEGRO_COLOR color) {
+
+    RenderBuffer *buffer = renderRecording;
+    RenderCommand *cmd;
+
+    if (buffer->length == buffer->size) {
+        buffer->size = buffer->size > 0 ? buffer->size * 2 : RENDER_BUFFER_MIN_SIZE;
+        buffer->commands = realloc(buffer->commands, buffer->size * sizeof(RenderCommand));
+        if (buffer->commands == NULL) {
+            gameExit("Failed to grow render buffer.");
+        }
+    }
+
+    cmd = &buffer->commands[buffer->length++];
+    cmd->type = type;
+    cmd->color = color;
+    return cmd;
+
+}
+
+void renderLine(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color, float thickness) {
+    RenderCommand *cmd = renderAppend(RENDER_LINE, color);
+    cmd->thickness = thickness;
+    cmd->v[0] = x1;
+    cmd->v[1] = y1;
+    cmd->v[2] = x2;
+    cmd->v[3] = y2;
+}
+
+void renderTriangle(float x1, float y1, float x2, float y2, float x3, float y3, 
+                    ALLEGRO_COLOR color, float thickness, bool filled) {
+
+    RenderCommand *cmd = renderAppend(RENDER_TRIANGLE, color);
+    cmd->thickness = thickness;
+    cmd->filled = filled;
+    cmd->v[0] = x1;
+    cmd->v[1] = y1;
+    cmd->v[2] = x2;
+    cmd->v[3] = y2;
+    cmd->v[4] = x3;
+    cmd->v[5] = y3;
+
+}
+
+void renderRect(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color, float thickness, bool filled) {
+    RenderCommand *cmd = renderAppend(RENDER_RECT, color);
+    cmd->thickness = thickness;
+    cmd->filled = filled;
+    cmd->v[0] = x1;
+    cmd->v[1] = y1;
+    cmd->v[2] = x2;
+    cmd->v[3] = y2;
+}
+
+void renderCircle(float x, float y, float r, ALLEGRO_COLOR color, float thickness, bool filled) {
+    RenderCommand *cmd = renderAppend(RENDER_CIRCLE, color);
+    cmd->thickness = thickness;
+    cmd->filled = filled;
+    cmd->v[0] = x;
+    cmd->v[1] = y;
+    cmd->v[2] = r;
+}
+
+void renderBitmap(ALLEGRO_BITMAP *bitmap, float sx, float sy, float sw, float sh, 
+                  float dx, float dy, ALLEGRO_COLOR tint, int flags) {
+
+    RenderCommand *cmd = renderAppend(RENDER_BITMAP, tint);
+    cmd->bitmap = bitmap;
+    cmd->flags = flags;
+    cmd->tinted = tint.r != 1 || tint.g != 1 || tint.b != 1 || tint.a != 1;
+    cmd->v[0] = sx;
+    cmd->v[1] = sy;
+    cmd->v[2] = sw;
+    cmd->v[3] = sh;
+    cmd->v[4] = dx;
+    cmd->v[5] = dy;
+
+}
+
+
+// Drawing --------------------------------------------------------------------
+static void renderResize(RenderBuffer *buffer) {
+
+    al_resize_display(graphicsDisplay, buffer->width * buffer->scale, buffer->height * buffer->scale);
+
+    if (graphicsBackground != NULL) {
+        al_destroy_bitmap(graphicsBackground);
+        graphicsBackground = NULL;
+    }
+
+    if (buffer->scale != 1) {
+        graphicsBackground = al_create_bitmap(buffer->width, buffer->height);
+    }
+
+}
+
+static void renderExecute(RenderBuffer *buffer) {
+
+    unsigned int i;
+    RenderCommand *cmd;
+    float *v;
+    double start;
+
+    if (buffer->scale != 1) {
+        al_set_target_bitmap(graphicsBackground);
+
+    } else {
+        al_set_target_backbuffer(graphicsDisplay);
+    }
+
+    al_clear_to_color(buffer->background);
+
+    for(i = 0; i < buffer->length; i++) {
+
+        cmd = &buffer->commands[i];
+        v = cmd->v;
+
+        switch(cmd->type) {
+            case RENDER_LINE:
+                al_draw_line(v[0], v[1], v[2], v[3], cmd->color, cmd->thickness);
+                break;
+
+            case RENDER_TRIANGLE:
+                if (cmd->filled) {
+                    al_draw_filled_triangle(v[0], v[1], v[2], v[3], v[4], v[5], cmd->color);
+
+                } else {
+                    al_draw_triangle(v[0], v[1], v[2], v[3], v[4], v[5], cmd->color, cmd->thickness);
+                }
+                break;
+
+            case RENDER_RECT:
+                if (cmd->filled) {
+                    al_draw_filled_rectangle(v[0], v[1], v[2], v[3], cmd->color);
+
+                } else {
+                    al_draw_rectangle(v[0], v[1], v[2], v[3], cmd->color, cmd->thickness);
+                }
+                break;
+
+            case RENDER_CIRCLE:
+                if (cmd->filled) {
+                    al_draw_filled_circle(v[0], v[1], v[2], cmd->color);
+
+                } else {
+                    al_draw_circle(v[0], v[1], v[2], cmd->color, cmd->thickness);
+                }
+                break;
+
+            case RENDER_BITMAP:
+                if (cmd->tinted) {
+                    al_draw_tinted_bitmap_region(cmd->bitmap, cmd->color, v[0], v[1], v[2], v[3], 
+                                                 v[4], v[5], cmd->flags);
+
+                } else {
+                    al_draw_bitmap_region(cmd->bitmap, v[0], v[1], v[2], v[3], v[4], v[5], cmd->flags);
+                }
+                break;
+
+            default:
+                break;
+        }
+
+    }
+
+    // Scale up if necessary
+    start = al_get_time();
+    if (buffer->scale != 1) {
+        al_set_target_backbuffer(graphicsDisplay);
+        al_draw_scaled_bitmap(graphicsBackground, 0, 0, buffer->width, buffer->height, 0, 0, 
+                              buffer->width * buffer->scale, buffer->height * buffer->scale, 0);
+    }
+    buffer->blitTime = al_get_time() - start;
+
+    start = al_get_time();
+    traceBegin("flip");
+    al_flip_display();
+    traceEnd("flip");
+    buffer->flipTime = al_get_time() - start;
+
+}
+
+
+// Thread ---------------------------------------------------------------------
+static void *renderThreadLoop(ALLEGRO_THREAD *thread, void *arg) {
+
+    RenderBuffer *buffer;
+
+    debugLog("render: thread started...\n");
+
+    while(true) {
+
+        al_lock_mutex(renderMutex);
+        while(renderPending == NULL && !al_get_thread_should_stop(thread)) {
+            al_wait_cond(renderCond, renderMutex);
+        }
+
+        buffer = renderPending;
+        al_unlock_mutex(renderMutex);
+
+        if (buffer == NULL) {
+            break;
+        }
+
+        // The display's context is only borrowed for the duration of the
+        // frame so the main thread can still create bitmaps in between
+        renderExecute(buffer);
+        al_set_target_bitmap(NULL);
+
+        al_lock_mutex(renderMutex);
+        renderPending = NULL;
+        al_broadcast_cond(renderCond);
+        al_unlock_mutex(renderMutex);
+
+    }
+
+    debugLog("render: thread stopped...\n");
+    return NULL;
+
+}
+
+// Blocks until the render thread has drawn the last submitted frame
+static void renderWait() {
+    al_lock_mutex(renderMutex);
+    while(renderPending != NULL) {
+        al_wait_cond(renderCond, renderMutex);
+    }
+    al_unlock_mutex(renderMutex);
+}
+
+
+// Frames ---------------------------------------------------------------------
+void renderInit(bool threaded) {
+
+    renderThreaded = threaded;
+    if (!renderThreaded) {
+        return;
+    }
+
+    debugLog("render: init thread...\n");
+
+    renderMutex = al_create_mutex();
+    renderCond = al_create_cond();
+    renderThread = al_create_thread(renderThreadLoop, NULL);
+
+    if (renderMutex == NULL || renderCond == NULL || renderThread == NULL) {
+        gameExit("Failed to create render thread.");
+    }
+
+    // Hand the display over to the render thread
+    al_set_target_bitmap(NULL);
+    al_start_thread(renderThread);
+
+}
+
+void renderBegin() {
+    renderRecording->length = 0;
+}
+
+void renderEnd() {
+
+    RenderBuffer *buffer = renderRecording;
+    RenderBuffer *previous;
+
+    buffer->background = graphicsBackgroundColor;
+    buffer->width = graphicsWidth;
+    buffer->height = graphicsHeight;
+    buffer->scale = graphicsScale;
+
+    // Display calls have to happen on the thread which created the display
+    if (graphicsResized) {
+        renderAcquire();
+        renderResize(buffer);
+        renderRelease();
+        graphicsResized = false;
+    }
+
+    if (!renderThreaded) {
+        renderExecute(buffer);
+        statsAdd(STATS_BLIT, buffer->blitTime);
+        statsAdd(STATS_FLIP, buffer->flipTime);
+        return;
+    }
+
+    // Wait for the previous frame and hand over this one, Lua can then record
+    // the next frame into the other buffer while this one is drawn
+    al_lock_mutex(renderMutex);
+    while(renderPending != NULL) {
+        al_wait_cond(renderCond, renderMutex);
+    }
+
+    // The timings of the previous frame end up in this one
+    previous = buffer == &renderBuffers[0] ? &renderBuffers[1] : &renderBuffers[0];
+    statsAdd(STATS_BLIT, previous->blitTime);
+    statsAdd(STATS_FLIP, previous->flipTime);
+
+    renderPending = buffer;
+    al_broadcast_cond(renderCond);
+    al_unlock_mutex(renderMutex);
+
+    renderRecording = buffer == &renderBuffers[0] ? &renderBuffers[1] : &renderBuffers[0];
+
+}
+
+// Makes the display usable from the main thread, e.g. to create video bitmaps
+void renderAcquire() {
+    if (renderThreaded) {
+        renderWait();
+        al_set_target_backbuffer(graphicsDisplay);
+    }
+}
+
+void renderRelease() {
+    if (renderThreaded) {
+        al_set_target_bitmap(NULL);
+    }
+}
+
+void renderCleanup() {
+
+    unsigned int i;
+
+    if (renderThreaded) {
+
+        al_set_thread_should_stop(renderThread);
+        al_lock_mutex(renderMutex);
+        al_broadcast_cond(renderCond);
+        al_unlock_mutex(renderMutex);
+
+        al_join_thread(renderThread, NULL);
+        al_destroy_thread(renderThread);
+        al_destroy_cond(renderCond);
+        al_destroy_mutex(renderMutex);
+
+        renderThread = NULL;
+        renderThreaded = false;
+
+        // Take the display back so bitmaps can be destroyed
+        al_set_target_backbuffer(graphicsDisplay);
+
+    }
+
+    for(i = 0; i < 2; i++) {
+        free(renderBuffers[i].commands);
+        renderBuffers[i].commands = NULL;
+        renderBuffers[i].length = 0;
+        renderBuffers[i].size = 0;
+    }
+
+}
+
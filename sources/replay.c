@@ -0,0 +1,325 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/replay.h"
+
+// Replay files start with a small header followed by a list of records, each
+// record is prefixed with the number of ticks since the previous one
+//
+//   header:   "KRPL" version:u8 fps:u8
+//   record:   ticks:varint type:u8 payload
+//
+#define REPLAY_VERSION 1
+
+typedef enum ReplayType {
+    REPLAY_END = 0,
+    REPLAY_KEY,             // code:u8 state:u8
+    REPLAY_MOUSE,           // button:u8 state:u8
+    REPLAY_POSITION,        // x:i16 y:i16
+    REPLAY_COUNT,           // keys:u8 buttons:u8
+    REPLAY_FOCUS            // keyboard:u8 mouse:u8
+
+} ReplayType;
+
+THREAD_LOCAL bool replayIsRecording = false;
+THREAD_LOCAL bool replayIsPlaying = false;
+
+static THREAD_LOCAL FILE *replayFile = NULL;
+static THREAD_LOCAL unsigned long replayTick = 0;
+static THREAD_LOCAL unsigned long replayLastTick = 0;
+static THREAD_LOCAL unsigned long replayNextTick = 0;
+static THREAD_LOCAL int replayNextType = REPLAY_END;
+
+// The input state the game saw during the last recorded step
+static THREAD_LOCAL int replayKeys[ALLEGRO_KEY_MAX];
+static THREAD_LOCAL int replayMouse[MAX_MOUSE];
+static THREAD_LOCAL int replayMouseX = -1;
+static THREAD_LOCAL int replayMouseY = -1;
+static THREAD_LOCAL int replayKeyCount = 0;
+static THREAD_LOCAL int replayMouseCount = 0;
+static THREAD_LOCAL bool replayHasKeyboard = false;
+static THREAD_LOCAL bool replayHasMouse = false;
+
+
+// Encoding -------------------------------------------------------------------
+static void writeByte(int value) {
+    fputc(value & 0xff, replayFile);
+}
+
+static void writeShort(int value) {
+    writeByte(value);
+    writeByte(value >> 8);
+}
+
+static void writeRecord(ReplayType type) {
+
+    unsigned long delta = replayTick - replayLastTick;
+    replayLastTick = replayTick;
+
+    // Variable length tick delta, 7 bits per byte
+    while(delta >= 0x80) {
+        writeByte((delta & 0x7f) | 0x80);
+        delta >>= 7;
+    }
+
+    writeByte(delta);
+    writeByte(type);
+
+}
+
+static int readByte() {
+    int c = fgetc(replayFile);
+    return c == EOF ? 0 : c;
+}
+
+static int readShort() {
+    int lo = readByte();
+    int hi = readByte();
+    return (short)(lo | (hi << 8));
+}
+
+static void readRecord() {
+
+    unsigned long delta = 0;
+    unsigned int shift = 0;
+    int c;
+
+    do {
+        c = fgetc(replayFile);
+        if (c == EOF) {
+            replayNextType = REPLAY_END;
+            return;
+        }
+
+        delta |= (unsigned long)(c & 0x7f) << shift;
+        shift += 7;
+
+    } while(c & 0x80);
+
+    replayNextTick += delta;
+    replayNextType = readByte();
+
+}
+
+
+// Recording ------------------------------------------------------------------
+bool replayRecord(const char *filename) {
+
+    unsigned int i;
+
+    replayFile = fopen(filename, "wb");
+    if (replayFile == NULL) {
+        debugLog("replay: Failed to open \"%s\" for recording\n", filename);
+        return false;
+    }
+
+    fwrite("KRPL", 1, 4, replayFile);
+    writeByte(REPLAY_VERSION);
+    writeByte(graphicsFrameRate);
+
+    for(i = 0; i < ALLEGRO_KEY_MAX; i++) replayKeys[i] = 0;
+    for(i = 0; i < MAX_MOUSE; i++) replayMouse[i] = 0;
+
+    debugLog("replay: recording to \"%s\"\n", filename);
+    replayIsRecording = true;
+    return true;
+
+}
+
+// Writes out everything that changed since the last step
+static void replayWriteChanges() {
+
+    unsigned int i;
+
+    for(i = 0; i < ALLEGRO_KEY_MAX; i++) {
+        if (keyStates[i] != replayKeys[i]) {
+            writeRecord(REPLAY_KEY);
+            writeByte(i);
+            writeByte(keyStates[i]);
+        }
+    }
+
+    for(i = 0; i < MAX_MOUSE; i++) {
+        if (mouseStates[i] != replayMouse[i]) {
+            writeRecord(REPLAY_MOUSE);
+            writeByte(i);
+            writeByte(mouseStates[i]);
+        }
+    }
+
+    if (mouseX != replayMouseX || mouseY != replayMouseY) {
+        writeRecord(REPLAY_POSITION);
+        writeShort(mouseX);
+        writeShort(mouseY);
+    }
+
+    if (keyCount != replayKeyCount || mouseCount != replayMouseCount) {
+        writeRecord(REPLAY_COUNT);
+        writeByte(keyCount);
+        writeByte(mouseCount);
+    }
+
+    if (stateHasKeyboard != replayHasKeyboard || stateHasMouse != replayHasMouse) {
+        writeRecord(REPLAY_FOCUS);
+        writeByte(stateHasKeyboard);
+        writeByte(stateHasMouse);
+    }
+
+}
+
+
+// Playback -------------------------------------------------------------------
+bool replayPlay(const char *filename) {
+
+    char magic[4];
+
+    replayFile = fopen(filename, "rb");
+    if (replayFile == NULL) {
+        debugLog("replay: Failed to open \"%s\" for playback\n", filename);
+        return false;
+    }
+
+    if (fread(magic, 1, 4, replayFile) != 4 || memcmp(magic, "KRPL", 4) != 0 
+                                            || readByte() != REPLAY_VERSION) {
+        debugLog("replay: \"%s\" is not a replay file\n", filename);
+        fclose(replayFile);
+        replayFile = NULL;
+        return false;
+    }
+
+    if (readByte() != graphicsFrameRate) {
+        debugLog("replay: \"%s\" was recorded with a different frame rate\n", filename);
+    }
+
+    debugLog("replay: playing \"%s\"\n", filename);
+    replayIsPlaying = true;
+    readRecord();
+    return true;
+
+}
+
+// Applies all records which are due for the current step
+static void replayReadChanges() {
+
+    int index;
+
+    while(replayNextType != REPLAY_END && replayNextTick == replayTick) {
+
+        switch(replayNextType) {
+            case REPLAY_KEY:
+                index = readByte();
+                keyStates[index % ALLEGRO_KEY_MAX] = readByte();
+                break;
+
+            case REPLAY_MOUSE:
+                index = readByte();
+                mouseStates[index % MAX_MOUSE] = readByte();
+                break;
+
+            case REPLAY_POSITION:
+                mouseX = readShort();
+                mouseY = readShort();
+                break;
+
+            case REPLAY_COUNT:
+                keyCount = readByte();
+                mouseCount = readByte();
+                break;
+
+            case REPLAY_FOCUS:
+                stateHasKeyboard = readByte();
+                stateHasMouse = readByte();
+                break;
+
+            default:
+                debugLog("replay: Invalid record type %d\n", replayNextType);
+                replayNextType = REPLAY_END;
+                return;
+        }
+
+        // Replayed input changes the screen just like live input
+        graphicsDirty = true;
+        readRecord();
+
+    }
+
+    // Stop the game once the replay is over
+    if (replayNextType == REPLAY_END && replayTick >= replayNextTick) {
+        debugLog("replay: finished after %lu ticks\n", replayTick);
+        replayIsPlaying = false;
+        stateIsRunning = false;
+    }
+
+}
+
+
+// Steps ----------------------------------------------------------------------
+void replayBeforeStep() {
+
+    if (replayIsRecording) {
+        replayWriteChanges();
+
+    } else if (replayIsPlaying) {
+        replayReadChanges();
+    }
+
+}
+
+void replayAfterStep() {
+
+    unsigned int i;
+
+    if (replayIsRecording) {
+
+        for(i = 0; i < ALLEGRO_KEY_MAX; i++) replayKeys[i] = keyStates[i];
+        for(i = 0; i < MAX_MOUSE; i++) replayMouse[i] = mouseStates[i];
+
+        replayMouseX = mouseX;
+        replayMouseY = mouseY;
+        replayKeyCount = keyCount;
+        replayMouseCount = mouseCount;
+        replayHasKeyboard = stateHasKeyboard;
+        replayHasMouse = stateHasMouse;
+
+    }
+
+    replayTick++;
+
+}
+
+void replayClose() {
+
+    if (replayFile == NULL) {
+        return;
+    }
+
+    if (replayIsRecording) {
+        writeRecord(REPLAY_END);
+        debugLog("replay: recorded %lu ticks\n", replayTick);
+    }
+
+    fclose(replayFile);
+    replayFile = NULL;
+    replayIsRecording = false;
+    replayIsPlaying = false;
+
+}
+
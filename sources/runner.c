@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/runner.h"
+
+// Each instance gets its own thread, Lua state and copy of the game state,
+// only Allegro itself and the bundle are shared
+typedef struct RunnerInstance {
+    int id;
+    unsigned int ticks;
+    ALLEGRO_THREAD *thread;
+
+} RunnerInstance;
+
+static void *runnerThread(ALLEGRO_THREAD *thread, void *arg) {
+
+    RunnerInstance *instance = (RunnerInstance*)arg;
+
+    gameInstance = instance->id;
+    debugLog("runner: instance %d started...\n", gameInstance);
+
+    luaInit();
+    gameLoad();
+    gameLoopHeadless(instance->ticks);
+    gameCleanup();
+    luaCleanup();
+
+    debugLog("runner: instance %d stopped...\n", gameInstance);
+    return NULL;
+
+}
+
+// Simulates several headless instances of the game side by side
+void runnerRun(unsigned int instances, unsigned int ticks) {
+
+    RunnerInstance runners[MAX_INSTANCES];
+    unsigned int i;
+    double start;
+
+    if (instances > MAX_INSTANCES) {
+        gameExit("Too many instances.");
+    }
+
+    debugLog("runner: starting %u instances...\n", instances);
+    start = al_get_time();
+
+    for(i = 0; i < instances; i++) {
+        runners[i].id = i;
+        runners[i].ticks = ticks;
+        runners[i].thread = al_create_thread(runnerThread, &runners[i]);
+        if (runners[i].thread == NULL) {
+            gameExit("Failed to create instance thread.");
+        }
+        al_start_thread(runners[i].thread);
+    }
+
+    for(i = 0; i < instances; i++) {
+        al_join_thread(runners[i].thread, NULL);
+        al_destroy_thread(runners[i].thread);
+    }
+
+    debugLog("runner: %u instances with %u ticks each in %.3f seconds\n", 
+             instances, ticks, al_get_time() - start);
+
+}
+
@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/sched.h"
+
+// The scheduler has its own tick count which stands still while the game is
+// paused, so sleeping tasks don't run out from under it
+static THREAD_LOCAL SchedTask *schedSlots[SCHED_SLOTS];
+static THREAD_LOCAL unsigned long schedTick = 0;
+static THREAD_LOCAL unsigned int schedCount = 0;
+
+
+// Tasks ----------------------------------------------------------------------
+static void schedInsert(SchedTask *task) {
+    unsigned int slot = task->due % SCHED_SLOTS;
+    task->next = schedSlots[slot];
+    schedSlots[slot] = task;
+}
+
+static void schedAdd(int ref, unsigned long due) {
+    SchedTask *task = (SchedTask*)malloc(sizeof(SchedTask));
+    task->ref = ref;
+    task->due = due;
+    schedInsert(task);
+    schedCount++;
+}
+
+static void schedRemove(SchedTask *task) {
+    luaL_unref(L, LUA_REGISTRYINDEX, task->ref);
+    free(task);
+    schedCount--;
+}
+
+// Runs the task until it waits again or ends, returns false once it is done
+static bool schedResume(SchedTask *task) {
+
+    int status, nargs;
+    lua_State *co;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, task->ref);
+    co = lua_tothread(L, -1);
+    lua_pop(L, 1);
+
+    // On the first run the function's arguments are still on the stack
+    nargs = lua_status(co) == LUA_OK ? lua_gettop(co) - 1 : 0;
+
+    // The hook the thread was created with is stale by now
+    luaHookThread(co);
+    status = lua_resume(co, L, nargs);
+
+    if (status == LUA_YIELD) {
+
+        // Plain coroutine.yield() waits for the next tick
+        task->due = schedTick + 1;
+        if (lua_gettop(co) > 0 && lua_isnumber(co, -1) && lua_tointeger(co, -1) > 1) {
+            task->due = schedTick + lua_tointeger(co, -1);
+        }
+
+        lua_settop(co, 0);
+        return true;
+
+    } else if (status != LUA_OK) {
+        luaL_traceback(L, co, lua_tostring(co, -1), 0);
+        debugLog("sched: task failed\n%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+
+    return false;
+
+}
+
+
+// Lua ------------------------------------------------------------------------
+// Runs the function at the given index as a new task during the next step,
+// any values above it are passed on as arguments
+void schedSpawn(lua_State *L, int index) {
+
+    int i, top = lua_gettop(L);
+    lua_State *co;
+
+    luaL_checktype(L, index, LUA_TFUNCTION);
+    co = lua_newthread(L);
+
+    for(i = index; i <= top; i++) {
+        lua_pushvalue(L, i);
+    }
+    lua_xmove(L, co, top - index + 1);
+
+    schedAdd(luaL_ref(L, LUA_REGISTRYINDEX), schedTick + 1);
+
+}
+
+// Suspends the calling task, must be used as the return value of a C function
+int schedWait(lua_State *L, unsigned long ticks) {
+
+    if (lua_pushthread(L)) {
+        return luaL_error(L, "can only wait inside a task started by game.spawn");
+    }
+    lua_pop(L, 1);
+
+    lua_pushinteger(L, ticks > 0 ? ticks : 1);
+    return lua_yield(L, 1);
+
+}
+
+
+// Stepping -------------------------------------------------------------------
+// Only the current slot of the wheel is looked at, so tasks which are asleep
+// cost nothing until they are due
+void schedStep() {
+
+    SchedTask *task, *next;
+    unsigned int slot;
+
+    if (stateIsPaused || schedCount == 0) {
+        return;
+    }
+
+    schedTick++;
+    slot = schedTick % SCHED_SLOTS;
+
+    // Detach the slot so tasks can be put back into it while it's processed
+    task = schedSlots[slot];
+    schedSlots[slot] = NULL;
+
+    while(task != NULL) {
+
+        next = task->next;
+        if (task->due > schedTick || schedResume(task)) {
+            schedInsert(task);
+
+        } else {
+            schedRemove(task);
+        }
+
+        task = next;
+
+    }
+
+}
+
+void schedCleanup() {
+
+    SchedTask *task;
+    unsigned int i;
+
+    for(i = 0; i < SCHED_SLOTS; i++) {
+        while(schedSlots[i] != NULL) {
+            task = schedSlots[i];
+            schedSlots[i] = task->next;
+            schedRemove(task);
+        }
+    }
+
+    schedTick = 0;
+
+}
+
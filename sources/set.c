@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/set.h"
+
+#define checkSet(L, i) ((Set*)luaL_checkudata(L, i, SET_TYPE))
+
+
+// ----------------------------------------------------------------------------
+// Helpers --------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+Set *setPush(lua_State *L) {
+
+    Set *s = (Set*)lua_newuserdata(L, sizeof(Set));
+    s->count = 0;
+    luaL_setmetatable(L, SET_TYPE);
+
+    lua_createtable(L, 2, 0);
+    lua_newtable(L);
+    lua_rawseti(L, -2, SET_ITEMS);
+    lua_newtable(L);
+    lua_rawseti(L, -2, SET_INDICES);
+    lua_setuservalue(L, -2);
+
+    return s;
+
+}
+
+// Pushes one of the set's tables
+static void setGetTable(lua_State *L, int index, int which) {
+    lua_getuservalue(L, index);
+    lua_rawgeti(L, -1, which);
+    lua_remove(L, -2);
+}
+
+static int setAddItem(lua_State *L, Set *s, int index, int item) {
+
+    setGetTable(L, index, SET_INDICES);
+    lua_pushvalue(L, item);
+    lua_rawget(L, -2);
+    if (!lua_isnil(L, -1)) {
+        lua_pop(L, 2);
+        return 0;
+    }
+    lua_pop(L, 1);
+
+    s->count++;
+    lua_pushvalue(L, item);
+    lua_pushinteger(L, s->count);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+
+    setGetTable(L, index, SET_ITEMS);
+    lua_pushvalue(L, item);
+    lua_rawseti(L, -2, s->count);
+    lua_pop(L, 1);
+
+    return 1;
+
+}
+
+void setAdd(lua_State *L, int index, int item) {
+    index = lua_absindex(L, index);
+    item = lua_absindex(L, item);
+    setAddItem(L, checkSet(L, index), index, item);
+}
+
+
+// ----------------------------------------------------------------------------
+// Set ------------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static int setNew(lua_State *L) {
+    setPush(L);
+    return 1;
+}
+
+static int setLuaAdd(lua_State *L) {
+    Set *s = checkSet(L, 1);
+    luaL_argcheck(L, !lua_isnoneornil(L, 2), 2, "can't add nil");
+    lua_pushboolean(L, setAddItem(L, s, 1, 2));
+    return 1;
+}
+
+// Moves the last item into the removed item's slot, so the order of the
+// remaining items changes
+static int setRemove(lua_State *L) {
+
+    Set *s = checkSet(L, 1);
+    int i;
+
+    luaL_checkany(L, 2);
+    lua_settop(L, 2);
+
+    setGetTable(L, 1, SET_ITEMS);
+    setGetTable(L, 1, SET_INDICES);
+
+    lua_pushvalue(L, 2);
+    lua_rawget(L, 4);
+    i = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+
+    if (i == 0) {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    if (i != s->count) {
+        lua_rawgeti(L, 3, s->count);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, 3, i);
+        lua_pushinteger(L, i);
+        lua_rawset(L, 4);
+    }
+
+    lua_pushnil(L);
+    lua_rawseti(L, 3, s->count);
+    lua_pushvalue(L, 2);
+    lua_pushnil(L);
+    lua_rawset(L, 4);
+    s->count--;
+
+    lua_pushboolean(L, true);
+    return 1;
+
+}
+
+static int setHas(lua_State *L) {
+    checkSet(L, 1);
+    luaL_checkany(L, 2);
+    setGetTable(L, 1, SET_INDICES);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    lua_pushboolean(L, !lua_isnil(L, -1));
+    return 1;
+}
+
+// Returns the position of an item, or nil
+static int setFind(lua_State *L) {
+    checkSet(L, 1);
+    luaL_checkany(L, 2);
+    setGetTable(L, 1, SET_INDICES);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    return 1;
+}
+
+static int setClear(lua_State *L) {
+
+    Set *s = checkSet(L, 1);
+    lua_getuservalue(L, 1);
+    lua_newtable(L);
+    lua_rawseti(L, -2, SET_ITEMS);
+    lua_newtable(L);
+    lua_rawseti(L, -2, SET_INDICES);
+    s->count = 0;
+    return 0;
+
+}
+
+// The backing array itself, it is only valid to read from it, but hot loops
+// save the call into C per element
+static int setItems(lua_State *L) {
+    checkSet(L, 1);
+    setGetTable(L, 1, SET_ITEMS);
+    return 1;
+}
+
+static int setLen(lua_State *L) {
+    lua_pushinteger(L, checkSet(L, 1)->count);
+    return 1;
+}
+
+static int setIndex(lua_State *L) {
+
+    checkSet(L, 1);
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        setGetTable(L, 1, SET_ITEMS);
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+
+    } else {
+        luaL_getmetafield(L, 1, "__methods");
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+    }
+
+    return 1;
+
+}
+
+static int setNext(lua_State *L) {
+
+    int i = luaL_checkint(L, 2) + 1;
+    if (i > checkSet(L, 1)->count) {
+        return 0;
+    }
+
+    lua_pushinteger(L, i);
+    setGetTable(L, 1, SET_ITEMS);
+    lua_rawgeti(L, -1, i);
+    lua_remove(L, -2);
+    return 2;
+
+}
+
+static int setIPairs(lua_State *L) {
+    checkSet(L, 1);
+    lua_pushcfunction(L, setNext);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+    return 3;
+}
+
+static int setToString(lua_State *L) {
+    lua_pushfstring(L, "set(%d)", checkSet(L, 1)->count);
+    return 1;
+}
+
+static const luaL_Reg setMethods[] = {
+    { "add", setLuaAdd },
+    { "remove", setRemove },
+    { "has", setHas },
+    { "find", setFind },
+    { "clear", setClear },
+    { "items", setItems },
+    { NULL, NULL }
+};
+
+static const luaL_Reg setMeta[] = {
+    { "__index", setIndex },
+    { "__len", setLen },
+    { "__ipairs", setIPairs },
+    { "__tostring", setToString },
+    { NULL, NULL }
+};
+
+void setInit(lua_State *L) {
+
+    luaL_newmetatable(L, SET_TYPE);
+    luaL_setfuncs(L, setMeta, 0);
+
+    lua_newtable(L);
+    luaL_setfuncs(L, setMethods, 0);
+    lua_setfield(L, -2, "__methods");
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    lua_pushcfunction(L, setNew);
+    lua_setfield(L, -2, "new");
+    lua_setglobal(L, SET_TYPE);
+
+}
+
@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/stats.h"
+
+// Number of frames kept in the ring buffer
+#define STATS_FRAMES 120
+
+THREAD_LOCAL bool statsOverlay = false;
+
+static THREAD_LOCAL double statsFrames[STATS_FRAMES][STATS_COUNT];
+static THREAD_LOCAL unsigned int statsOverruns[STATS_FRAMES];
+static THREAD_LOCAL double statsStart[STATS_COUNT];
+static THREAD_LOCAL double statsFrameStart = 0;
+static THREAD_LOCAL unsigned int statsIndex = 0;
+static THREAD_LOCAL unsigned int statsFilled = 0;
+
+static const char *statsNames[STATS_COUNT] = {
+    "events", "update", "render", "blit", "flip", "gc", "frame"
+};
+
+
+// Recording ------------------------------------------------------------------
+void statsBegin(StatsPhase phase) {
+    statsStart[phase] = al_get_time();
+}
+
+// Phases can be entered multiple times per frame, their times add up
+void statsEnd(StatsPhase phase) {
+    statsFrames[statsIndex][phase] += al_get_time() - statsStart[phase];
+}
+
+// Adds time which was measured elsewhere, e.g. on the render thread
+void statsAdd(StatsPhase phase, double seconds) {
+    statsFrames[statsIndex][phase] += seconds;
+}
+
+void statsNextFrame() {
+
+    unsigned int i;
+    double now = al_get_time();
+
+    if (statsFrameStart != 0) {
+        statsFrames[statsIndex][STATS_FRAME] = now - statsFrameStart;
+    }
+
+    statsFrameStart = now;
+    statsIndex = (statsIndex + 1) % STATS_FRAMES;
+    if (statsFilled < STATS_FRAMES) {
+        statsFilled++;
+    }
+
+    for(i = 0; i < STATS_COUNT; i++) {
+        statsFrames[statsIndex][i] = 0;
+    }
+    statsOverruns[statsIndex] = 0;
+
+}
+
+// Counts a call into Lua which exceeded the frame budget
+void statsOverrun() {
+    statsOverruns[statsIndex]++;
+}
+
+
+// Queries --------------------------------------------------------------------
+static int compareTimes(const void *a, const void *b) {
+    double d = *(const double*)a - *(const double*)b;
+    return d < 0 ? -1 : (d > 0 ? 1 : 0);
+}
+
+// Returns the times of the last completed frames in milliseconds
+void statsGet(StatsPhase phase, double *min, double *avg, double *p99) {
+
+    double times[STATS_FRAMES];
+    double sum = 0;
+    unsigned int i, count = 0, index;
+
+    // Skip the frame which is currently being recorded
+    for(i = 1; i <= statsFilled && i < STATS_FRAMES; i++) {
+        index = (statsIndex + STATS_FRAMES - i) % STATS_FRAMES;
+        times[count] = statsFrames[index][phase] * 1000;
+        sum += times[count];
+        count++;
+    }
+
+    if (count == 0) {
+        *min = *avg = *p99 = 0;
+        return;
+    }
+
+    qsort(times, count, sizeof(double), compareTimes);
+
+    *min = times[0];
+    *avg = sum / count;
+    *p99 = times[(count * 99 - 1) / 100];
+
+}
+
+// Returns the number of budget overruns during the last frames
+unsigned int statsGetOverruns() {
+
+    unsigned int i, count = 0;
+    for(i = 1; i <= statsFilled && i < STATS_FRAMES; i++) {
+        count += statsOverruns[(statsIndex + STATS_FRAMES - i) % STATS_FRAMES];
+    }
+
+    return count;
+
+}
+
+const char *statsGetName(StatsPhase phase) {
+    return statsNames[phase];
+}
+
+
+// Overlay --------------------------------------------------------------------
+// Draws a stacked bar per frame, one pixel per millisecond, with a line
+// marking the frame budget and a red mark above frames with overruns
+void statsRender(int x, int y, double budget) {
+
+    unsigned int i, p, index;
+    double top, height;
+    ALLEGRO_COLOR colors[STATS_FRAME] = {
+        al_map_rgba(128, 128, 128, 192),
+        al_map_rgba(0, 160, 255, 192),
+        al_map_rgba(0, 220, 0, 192),
+        al_map_rgba(220, 220, 0, 192),
+        al_map_rgba(220, 0, 0, 192),
+        al_map_rgba(220, 0, 220, 192)
+    };
+
+    for(i = 1; i <= statsFilled && i < STATS_FRAMES; i++) {
+
+        index = (statsIndex + STATS_FRAMES - i) % STATS_FRAMES;
+        top = y;
+
+        for(p = 0; p < STATS_FRAME; p++) {
+            height = statsFrames[index][p] * 1000;
+            renderRect(x + STATS_FRAMES - i, top - height, 
+                       x + STATS_FRAMES - i + 1, top, colors[p], 0, true);
+            top -= height;
+        }
+
+        if (statsOverruns[index] > 0) {
+            renderRect(x + STATS_FRAMES - i, top - 3, x + STATS_FRAMES - i + 1, top - 1, 
+                       al_map_rgba(255, 0, 0, 255), 0, true);
+        }
+
+    }
+
+    renderLine(x, y - budget * 1000, x + STATS_FRAMES, y - budget * 1000, 
+               al_map_rgba(255, 255, 255, 255), 1);
+
+}
+
@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/trace.h"
+
+bool traceEnabled = false;
+
+static const char *traceFilename = NULL;
+static ALLEGRO_MUTEX *traceMutex = NULL;
+static TraceBuffer *traceBuffers = NULL;
+static int traceThreads = 0;
+static double traceOrigin = 0;
+
+static THREAD_LOCAL TraceBuffer *traceBuffer = NULL;
+
+
+// Recording ------------------------------------------------------------------
+void traceStart(const char *filename) {
+
+    debugLog("trace: recording to \"%s\"...\n", filename);
+
+    traceFilename = filename;
+    traceMutex = al_create_mutex();
+    traceOrigin = al_get_time();
+    traceEnabled = true;
+
+}
+
+static TraceChunk *traceAddChunk(TraceBuffer *buffer) {
+
+    TraceChunk *chunk = (TraceChunk*)calloc(1, sizeof(TraceChunk));
+    if (buffer->last != NULL) {
+        buffer->last->next = chunk;
+
+    } else {
+        buffer->first = chunk;
+    }
+
+    buffer->last = chunk;
+    return chunk;
+
+}
+
+// Called the first time a thread records something
+static void traceAddThread() {
+
+    traceBuffer = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+    traceAddChunk(traceBuffer);
+
+    al_lock_mutex(traceMutex);
+    traceBuffer->id = traceThreads++;
+    traceBuffer->next = traceBuffers;
+    traceBuffers = traceBuffer;
+    al_unlock_mutex(traceMutex);
+
+}
+
+static void traceEvent(const char *name, char phase) {
+
+    TraceChunk *chunk;
+    TraceEvent *event;
+
+    if (traceBuffer == NULL) {
+        traceAddThread();
+    }
+
+    chunk = traceBuffer->last;
+    if (chunk->length == TRACE_CHUNK_SIZE) {
+        chunk = traceAddChunk(traceBuffer);
+    }
+
+    event = &chunk->events[chunk->length];
+    event->name = name;
+    event->phase = phase;
+    event->time = al_get_time();
+
+    // Only count the event once it has been written completely
+    __sync_synchronize();
+    chunk->length++;
+
+}
+
+void traceBegin(const char *name) {
+    if (traceEnabled) {
+        traceEvent(name, 'B');
+    }
+}
+
+void traceEnd(const char *name) {
+    if (traceEnabled) {
+        traceEvent(name, 'E');
+    }
+}
+
+
+// Output ---------------------------------------------------------------------
+// Writes everything recorded so far in the trace event format, which can be
+// loaded by chrome://tracing and similar viewers
+bool traceDump(const char *filename) {
+
+    FILE *fp;
+    TraceBuffer *buffer;
+    TraceChunk *chunk;
+    TraceEvent *event;
+    unsigned int i, length;
+    bool first = true;
+
+    if (!traceEnabled) {
+        return false;
+    }
+
+    if (filename == NULL) {
+        filename = traceFilename;
+    }
+
+    fp = fopen(filename, "w");
+    if (fp == NULL) {
+        debugLog("trace: failed to open \"%s\"\n", filename);
+        return false;
+    }
+
+    fputs("{\"traceEvents\":[\n", fp);
+
+    al_lock_mutex(traceMutex);
+    for(buffer = traceBuffers; buffer != NULL; buffer = buffer->next) {
+        for(chunk = buffer->first; chunk != NULL; chunk = chunk->next) {
+
+            length = chunk->length;
+            __sync_synchronize();
+
+            for(i = 0; i < length; i++) {
+                event = &chunk->events[i];
+                fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}", 
+                        first ? "" : ",\n", event->name, event->phase, 
+                        (event->time - traceOrigin) * 1000000.0, buffer->id);
+
+                first = false;
+            }
+
+        }
+    }
+    al_unlock_mutex(traceMutex);
+
+    fputs("\n]}\n", fp);
+    fclose(fp);
+
+    debugLog("trace: written to \"%s\"\n", filename);
+    return true;
+
+}
+
+void traceCleanup() {
+
+    TraceBuffer *buffer;
+    TraceChunk *chunk;
+
+    if (!traceEnabled) {
+        return;
+    }
+
+    traceDump(NULL);
+    traceEnabled = false;
+
+    while(traceBuffers != NULL) {
+
+        buffer = traceBuffers;
+        traceBuffers = buffer->next;
+
+        while(buffer->first != NULL) {
+            chunk = buffer->first;
+            buffer->first = chunk->next;
+            free(chunk);
+        }
+
+        free(buffer);
+
+    }
+
+    traceBuffer = NULL;
+    al_destroy_mutex(traceMutex);
+    traceMutex = NULL;
+
+}
+
@@ -0,0 +1,458 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/vec.h"
+
+#define checkVec2(L, i) ((Vec2*)luaL_checkudata(L, i, VEC2_TYPE))
+#define checkAABB(L, i) ((AABB*)luaL_checkudata(L, i, AABB_TYPE))
+#define vecMin(a, b) ((a) < (b) ? (a) : (b))
+#define vecMax(a, b) ((a) > (b) ? (a) : (b))
+
+
+// ----------------------------------------------------------------------------
+// Vec2 -----------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+Vec2 *vecPush(lua_State *L, lua_Number x, lua_Number y) {
+    Vec2 *v = (Vec2*)lua_newuserdata(L, sizeof(Vec2));
+    v->x = x;
+    v->y = y;
+    luaL_setmetatable(L, VEC2_TYPE);
+    return v;
+}
+
+static int vec2New(lua_State *L) {
+    vecPush(L, luaL_optnumber(L, 1, 0), luaL_optnumber(L, 2, 0));
+    return 1;
+}
+
+static int vec2Index(lua_State *L) {
+
+    Vec2 *v = checkVec2(L, 1);
+    size_t len = 0;
+    const char *key = lua_type(L, 2) == LUA_TSTRING ? lua_tolstring(L, 2, &len) : NULL;
+
+    if (len == 1) {
+        if (key[0] == 'x') {
+            lua_pushnumber(L, v->x);
+            return 1;
+
+        } else if (key[0] == 'y') {
+            lua_pushnumber(L, v->y);
+            return 1;
+        }
+    }
+
+    // Methods
+    lua_getmetatable(L, 1);
+    lua_getfield(L, -1, "__methods");
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    return 1;
+
+}
+
+static int vec2NewIndex(lua_State *L) {
+
+    Vec2 *v = checkVec2(L, 1);
+    const char *key = luaL_checkstring(L, 2);
+
+    if (strcmp(key, "x") == 0) {
+        v->x = luaL_checknumber(L, 3);
+
+    } else if (strcmp(key, "y") == 0) {
+        v->y = luaL_checknumber(L, 3);
+
+    } else {
+        return luaL_error(L, "vec2 has no field '%s'", key);
+    }
+
+    return 0;
+
+}
+
+// Arithmetic -----------------------------------------------------------------
+static int vec2Add(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1), *b = checkVec2(L, 2);
+    vecPush(L, a->x + b->x, a->y + b->y);
+    return 1;
+}
+
+static int vec2Sub(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1), *b = checkVec2(L, 2);
+    vecPush(L, a->x - b->x, a->y - b->y);
+    return 1;
+}
+
+// Either vector * number, number * vector or component wise
+static int vec2Mul(lua_State *L) {
+
+    Vec2 *a, *b;
+
+    if (lua_isnumber(L, 1)) {
+        b = checkVec2(L, 2);
+        vecPush(L, b->x * lua_tonumber(L, 1), b->y * lua_tonumber(L, 1));
+
+    } else if (lua_isnumber(L, 2)) {
+        a = checkVec2(L, 1);
+        vecPush(L, a->x * lua_tonumber(L, 2), a->y * lua_tonumber(L, 2));
+
+    } else {
+        a = checkVec2(L, 1);
+        b = checkVec2(L, 2);
+        vecPush(L, a->x * b->x, a->y * b->y);
+    }
+
+    return 1;
+
+}
+
+static int vec2Div(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    lua_Number s = luaL_checknumber(L, 2);
+    vecPush(L, a->x / s, a->y / s);
+    return 1;
+}
+
+static int vec2Unm(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    vecPush(L, -a->x, -a->y);
+    return 1;
+}
+
+static int vec2Eq(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1), *b = checkVec2(L, 2);
+    lua_pushboolean(L, a->x == b->x && a->y == b->y);
+    return 1;
+}
+
+static int vec2Len(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    lua_pushnumber(L, sqrt(a->x * a->x + a->y * a->y));
+    return 1;
+}
+
+static int vec2ToString(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    lua_pushfstring(L, "vec2(%f, %f)", a->x, a->y);
+    return 1;
+}
+
+// In place, these all return the vector itself so calls can be chained ------
+static int vec2Set(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    a->x = luaL_checknumber(L, 2);
+    a->y = luaL_checknumber(L, 3);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int vec2Copy(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1), *b = checkVec2(L, 2);
+    a->x = b->x;
+    a->y = b->y;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int vec2AddInPlace(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1), *b = checkVec2(L, 2);
+    a->x += b->x;
+    a->y += b->y;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int vec2SubInPlace(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1), *b = checkVec2(L, 2);
+    a->x -= b->x;
+    a->y -= b->y;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int vec2Scale(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    lua_Number s = luaL_checknumber(L, 2);
+    a->x *= s;
+    a->y *= s;
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int vec2Normalize(lua_State *L) {
+
+    Vec2 *a = checkVec2(L, 1);
+    lua_Number len = sqrt(a->x * a->x + a->y * a->y);
+    if (len > 0) {
+        a->x /= len;
+        a->y /= len;
+    }
+
+    lua_settop(L, 1);
+    return 1;
+
+}
+
+// Queries --------------------------------------------------------------------
+static int vec2Clone(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    vecPush(L, a->x, a->y);
+    return 1;
+}
+
+static int vec2Dot(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1), *b = checkVec2(L, 2);
+    lua_pushnumber(L, a->x * b->x + a->y * b->y);
+    return 1;
+}
+
+static int vec2Unpack(lua_State *L) {
+    Vec2 *a = checkVec2(L, 1);
+    lua_pushnumber(L, a->x);
+    lua_pushnumber(L, a->y);
+    return 2;
+}
+
+static const luaL_Reg vec2Meta[] = {
+    { "__index", vec2Index },
+    { "__newindex", vec2NewIndex },
+    { "__add", vec2Add },
+    { "__sub", vec2Sub },
+    { "__mul", vec2Mul },
+    { "__div", vec2Div },
+    { "__unm", vec2Unm },
+    { "__eq", vec2Eq },
+    { "__len", vec2Len },
+    { "__tostring", vec2ToString },
+    { NULL, NULL }
+};
+
+static const luaL_Reg vec2Methods[] = {
+    { "set", vec2Set },
+    { "copy", vec2Copy },
+    { "add", vec2AddInPlace },
+    { "sub", vec2SubInPlace },
+    { "scale", vec2Scale },
+    { "normalize", vec2Normalize },
+    { "clone", vec2Clone },
+    { "dot", vec2Dot },
+    { "length", vec2Len },
+    { "unpack", vec2Unpack },
+    { NULL, NULL }
+};
+
+
+// ----------------------------------------------------------------------------
+// AABB -----------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+AABB *aabbPush(lua_State *L, lua_Number x, lua_Number y, lua_Number w, lua_Number h) {
+    AABB *b = (AABB*)lua_newuserdata(L, sizeof(AABB));
+    b->x = x;
+    b->y = y;
+    b->w = w;
+    b->h = h;
+    luaL_setmetatable(L, AABB_TYPE);
+    return b;
+}
+
+static int aabbNew(lua_State *L) {
+    aabbPush(L, luaL_optnumber(L, 1, 0), luaL_optnumber(L, 2, 0), 
+                luaL_optnumber(L, 3, 0), luaL_optnumber(L, 4, 0));
+    return 1;
+}
+
+// Reads a field by name, min and max are derived and can't be written
+static lua_Number aabbField(AABB *b, const char *key, bool *found) {
+
+    *found = true;
+    if (strcmp(key, "x") == 0 || strcmp(key, "minX") == 0) {
+        return b->x;
+
+    } else if (strcmp(key, "y") == 0 || strcmp(key, "minY") == 0) {
+        return b->y;
+
+    } else if (strcmp(key, "w") == 0) {
+        return b->w;
+
+    } else if (strcmp(key, "h") == 0) {
+        return b->h;
+
+    } else if (strcmp(key, "maxX") == 0) {
+        return b->x + b->w;
+
+    } else if (strcmp(key, "maxY") == 0) {
+        return b->y + b->h;
+    }
+
+    *found = false;
+    return 0;
+
+}
+
+static int aabbIndex(lua_State *L) {
+
+    AABB *b = checkAABB(L, 1);
+    const char *key = lua_tostring(L, 2);
+    bool found = false;
+    lua_Number value;
+
+    if (key != NULL) {
+        value = aabbField(b, key, &found);
+        if (found) {
+            lua_pushnumber(L, value);
+            return 1;
+        }
+    }
+
+    lua_getmetatable(L, 1);
+    lua_getfield(L, -1, "__methods");
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    return 1;
+
+}
+
+static int aabbNewIndex(lua_State *L) {
+
+    AABB *b = checkAABB(L, 1);
+    const char *key = luaL_checkstring(L, 2);
+    lua_Number value = luaL_checknumber(L, 3);
+
+    if (strcmp(key, "x") == 0) {
+        b->x = value;
+
+    } else if (strcmp(key, "y") == 0) {
+        b->y = value;
+
+    } else if (strcmp(key, "w") == 0) {
+        b->w = value;
+
+    } else if (strcmp(key, "h") == 0) {
+        b->h = value;
+
+    } else {
+        return luaL_error(L, "aabb has no writable field '%s'", key);
+    }
+
+    return 0;
+
+}
+
+static int aabbToString(lua_State *L) {
+    AABB *b = checkAABB(L, 1);
+    lua_pushfstring(L, "aabb(%f, %f, %f, %f)", b->x, b->y, b->w, b->h);
+    return 1;
+}
+
+static int aabbSet(lua_State *L) {
+    AABB *b = checkAABB(L, 1);
+    b->x = luaL_checknumber(L, 2);
+    b->y = luaL_checknumber(L, 3);
+    b->w = luaL_optnumber(L, 4, b->w);
+    b->h = luaL_optnumber(L, 5, b->h);
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int aabbClone(lua_State *L) {
+    AABB *b = checkAABB(L, 1);
+    aabbPush(L, b->x, b->y, b->w, b->h);
+    return 1;
+}
+
+// Touching edges count as overlapping, just like StaticBox:overlaps
+static int aabbOverlaps(lua_State *L) {
+    AABB *a = checkAABB(L, 1), *b = checkAABB(L, 2);
+    lua_pushboolean(L, !(a->x + a->w < b->x || a->x > b->x + b->w 
+                         || a->y + a->h < b->y || a->y > b->y + b->h));
+    return 1;
+}
+
+static int aabbOverlapArea(lua_State *L) {
+
+    AABB *a = checkAABB(L, 1), *b = checkAABB(L, 2);
+    lua_Number xo = vecMin(a->x + a->w, b->x + b->w) - vecMax(a->x, b->x);
+    lua_Number yo = vecMin(a->y + a->h, b->y + b->h) - vecMax(a->y, b->y);
+
+    lua_pushnumber(L, vecMax(0, xo) * vecMax(0, yo));
+    return 1;
+
+}
+
+static int aabbContains(lua_State *L) {
+    AABB *b = checkAABB(L, 1);
+    lua_Number x = luaL_checknumber(L, 2), y = luaL_checknumber(L, 3);
+    lua_pushboolean(L, b->x <= x && b->y <= y && b->x + b->w >= x && b->y + b->h >= y);
+    return 1;
+}
+
+static int aabbUnpack(lua_State *L) {
+    AABB *b = checkAABB(L, 1);
+    lua_pushnumber(L, b->x);
+    lua_pushnumber(L, b->y);
+    lua_pushnumber(L, b->w);
+    lua_pushnumber(L, b->h);
+    return 4;
+}
+
+static const luaL_Reg aabbMeta[] = {
+    { "__index", aabbIndex },
+    { "__newindex", aabbNewIndex },
+    { "__tostring", aabbToString },
+    { NULL, NULL }
+};
+
+static const luaL_Reg aabbMethods[] = {
+    { "set", aabbSet },
+    { "clone", aabbClone },
+    { "overlaps", aabbOverlaps },
+    { "overlapArea", aabbOverlapArea },
+    { "contains", aabbContains },
+    { "unpack", aabbUnpack },
+    { NULL, NULL }
+};
+
+
+// ----------------------------------------------------------------------------
+// Setup ----------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static void vecRegister(lua_State *L, const char *type, const luaL_Reg *meta, 
+                        const luaL_Reg *methods, lua_CFunction constructor) {
+
+    luaL_newmetatable(L, type);
+    luaL_setfuncs(L, meta, 0);
+    lua_newtable(L);
+    luaL_setfuncs(L, methods, 0);
+    lua_setfield(L, -2, "__methods");
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    lua_pushcfunction(L, constructor);
+    lua_setfield(L, -2, "new");
+    lua_setglobal(L, type);
+
+}
+
+void vecInit(lua_State *L) {
+    vecRegister(L, VEC2_TYPE, vec2Meta, vec2Methods, vec2New);
+    vecRegister(L, AABB_TYPE, aabbMeta, aabbMethods, aabbNew);
+}
+
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/watch.h"
+
+// Watching is only supported on Linux, everywhere else these do nothing
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_BUFFER 4096
+#define WATCH_MODULE 256
+
+static int watchFd = -1;
+
+void watchInit(const char *path) {
+
+    watchFd = inotify_init1(IN_NONBLOCK);
+    if (watchFd == -1) {
+        debugLog("watch: failed to initialize\n");
+        return;
+    }
+
+    // Editors either write the file or move a new one over it
+    if (inotify_add_watch(watchFd, path, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        debugLog("watch: failed to watch \"%s\"\n", path);
+        watchCleanup();
+        return;
+    }
+
+    debugLog("watch: watching \"%s\"...\n", path);
+
+}
+
+// Reloads every module that changed since the last poll
+void watchPoll() {
+
+    char buffer[WATCH_BUFFER];
+    char module[WATCH_MODULE];
+    char last[WATCH_MODULE] = "";
+    struct inotify_event *event;
+    ssize_t len, i;
+    size_t nameLen;
+
+    if (watchFd == -1) {
+        return;
+    }
+
+    while((len = read(watchFd, buffer, WATCH_BUFFER)) > 0) {
+
+        for(i = 0; i < len; i += sizeof(struct inotify_event) + event->len) {
+
+            event = (struct inotify_event*)(buffer + i);
+            if (event->len == 0) {
+                continue;
+            }
+
+            nameLen = strlen(event->name);
+            if (nameLen <= 4 || nameLen >= WATCH_MODULE 
+                || strcmp(event->name + nameLen - 4, ".lua") != 0) {
+                continue;
+            }
+
+            strncpy(module, event->name, nameLen - 4);
+            module[nameLen - 4] = '\0';
+
+            // A single save can show up more than once
+            if (strcmp(module, last) == 0) {
+                continue;
+            }
+            strcpy(last, module);
+
+            // main.lua isn't a module, it's everything
+            if (strcmp(module, "main") == 0) {
+                stateReload = true;
+
+            } else {
+                luaReloadModule(module);
+            }
+
+            graphicsDirty = true;
+
+        }
+
+    }
+
+}
+
+void watchCleanup() {
+    if (watchFd != -1) {
+        close(watchFd);
+        watchFd = -1;
+    }
+}
+
+#else
+
+void watchInit(const char *path) {
+}
+
+void watchPoll() {
+}
+
+void watchCleanup() {
+}
+
+#endif
+
@@ -0,0 +1,379 @@
+/**
+ * Copyright (c) 2012 Ivo Wetzel.
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "../include/worker.h"
+
+#define checkWorker(L, i) ((Worker**)luaL_checkudata(L, i, WORKER_TYPE))
+
+// Set on worker threads, NULL on the game's own threads
+static THREAD_LOCAL Worker *workerSelf = NULL;
+
+
+// ----------------------------------------------------------------------------
+// Channels -------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static void channelInit(WorkerChannel *channel) {
+    channel->mutex = al_create_mutex();
+    channel->cond = al_create_cond();
+    channel->first = NULL;
+    channel->last = NULL;
+    channel->closed = false;
+}
+
+static void channelPush(WorkerChannel *channel, const char *data, size_t length) {
+
+    WorkerMessage *msg = (WorkerMessage*)malloc(sizeof(WorkerMessage) + length);
+    msg->next = NULL;
+    msg->length = length;
+    memcpy(msg->data, data, length);
+
+    al_lock_mutex(channel->mutex);
+    if (channel->last) {
+        channel->last->next = msg;
+
+    } else {
+        channel->first = msg;
+    }
+    channel->last = msg;
+    al_signal_cond(channel->cond);
+    al_unlock_mutex(channel->mutex);
+
+}
+
+// Waits up to timeout seconds for a message, forever if timeout is negative,
+// returns NULL once the channel has been closed and drained
+static WorkerMessage *channelPop(WorkerChannel *channel, double timeout) {
+
+    ALLEGRO_TIMEOUT until;
+    WorkerMessage *msg;
+
+    al_lock_mutex(channel->mutex);
+    if (timeout > 0) {
+        al_init_timeout(&until, timeout);
+    }
+
+    while(channel->first == NULL && !channel->closed && timeout != 0) {
+        if (timeout < 0) {
+            al_wait_cond(channel->cond, channel->mutex);
+
+        } else if (al_wait_cond_until(channel->cond, channel->mutex, &until)) {
+            break;
+        }
+    }
+
+    msg = channel->first;
+    if (msg) {
+        channel->first = msg->next;
+        if (channel->first == NULL) {
+            channel->last = NULL;
+        }
+    }
+    al_unlock_mutex(channel->mutex);
+
+    return msg;
+
+}
+
+static void channelClose(WorkerChannel *channel) {
+    al_lock_mutex(channel->mutex);
+    channel->closed = true;
+    al_broadcast_cond(channel->cond);
+    al_unlock_mutex(channel->mutex);
+}
+
+static void channelDestroy(WorkerChannel *channel) {
+
+    WorkerMessage *msg, *next;
+    for(msg = channel->first; msg; msg = next) {
+        next = msg->next;
+        free(msg);
+    }
+
+    al_destroy_cond(channel->cond);
+    al_destroy_mutex(channel->mutex);
+
+}
+
+// Copies the value at index into the channel
+static void channelSend(lua_State *L, WorkerChannel *channel, int index) {
+
+    size_t len;
+    const char *buf;
+
+    luaL_argcheck(L, !lua_isnoneornil(L, index), index, "can't send nil");
+    buf = dataSerialize(L, index, &len);
+    channelPush(channel, buf, len);
+
+}
+
+// Pushes the next value from the channel, or nil
+static int channelReceive(lua_State *L, WorkerChannel *channel, double timeout) {
+
+    WorkerMessage *msg = channelPop(channel, timeout);
+    const char *buf;
+    size_t len;
+
+    if (msg == NULL) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // Decode from a Lua copy so the message is freed even if it is broken
+    lua_pushlstring(L, msg->data, msg->length);
+    free(msg);
+
+    buf = lua_tolstring(L, -1, &len);
+    dataDeserialize(L, buf, len);
+    lua_remove(L, -2);
+    return 1;
+
+}
+
+
+// ----------------------------------------------------------------------------
+// Worker Thread --------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static void workerStopHook(lua_State *L, lua_Debug *ar) {
+    luaL_error(L, "worker stopped");
+}
+
+static int workerSend(lua_State *L) {
+    channelSend(L, &workerSelf->outbox, 1);
+    return 0;
+}
+
+static int workerReceive(lua_State *L) {
+    return channelReceive(L, &workerSelf->inbox, luaL_optnumber(L, 1, -1));
+}
+
+static int workerPoll(lua_State *L) {
+    return channelReceive(L, &workerSelf->inbox, 0);
+}
+
+static int workerGetModule(lua_State *L) {
+    lua_pushstring(L, workerSelf->module);
+    return 1;
+}
+
+// Workers only get the standard libraries, vec2, aabb, data and their side
+// of the channels, nothing in here may touch Allegro's display or audio
+static void workerAPI(lua_State *L) {
+
+    lua_newtable(L);
+
+    lua_pushcfunction(L, workerSend);
+    lua_setfield(L, -2, "send");
+
+    lua_pushcfunction(L, workerReceive);
+    lua_setfield(L, -2, "receive");
+
+    lua_pushcfunction(L, workerPoll);
+    lua_setfield(L, -2, "poll");
+
+    lua_pushcfunction(L, workerGetModule);
+    lua_setfield(L, -2, "getModule");
+
+    lua_setglobal(L, "worker");
+
+}
+
+static void *workerThread(ALLEGRO_THREAD *thread, void *arg) {
+
+    Worker *w = (Worker*)arg;
+    char *filename;
+    bool stopped;
+
+    workerSelf = w;
+    gameInstance = w->instance;
+    debugLog("worker: \"%s\" started...\n", w->module);
+
+    L = luaNewState();
+    if (L == NULL) {
+        debugLog("worker: failed to create lua state\n");
+        channelClose(&w->outbox);
+        return NULL;
+    }
+
+    workerAPI(L);
+
+    // A stop that came in before the state was published could not install
+    // the hook, so it has to be checked here
+    al_lock_mutex(w->inbox.mutex);
+    w->state = L;
+    stopped = w->inbox.closed;
+    al_unlock_mutex(w->inbox.mutex);
+
+    // The module runs until it returns, usually it loops on worker.receive
+    if (!stopped) {
+        filename = (char*)calloc(strlen(w->module) + 5, sizeof(char));
+        strcat(filename, w->module);
+        strcat(filename, ".lua");
+        luaRequire(filename);
+        free(filename);
+    }
+
+    al_lock_mutex(w->inbox.mutex);
+    w->state = NULL;
+    al_unlock_mutex(w->inbox.mutex);
+
+    lua_close(L);
+    poolDestroy(&luaPool);
+    L = NULL;
+
+    // Lets a blocking wait on the other side return
+    channelClose(&w->outbox);
+    debugLog("worker: \"%s\" stopped...\n", w->module);
+    return NULL;
+
+}
+
+
+// ----------------------------------------------------------------------------
+// Handles --------------------------------------------------------------------
+// ----------------------------------------------------------------------------
+static void workerStop(Worker *w) {
+
+    // Wake up a blocked receive and interrupt any running Lua code
+    al_lock_mutex(w->inbox.mutex);
+    w->inbox.closed = true;
+    al_broadcast_cond(w->inbox.cond);
+    if (w->state) {
+        lua_sethook(w->state, workerStopHook, LUA_MASKCOUNT, 1);
+    }
+    al_unlock_mutex(w->inbox.mutex);
+
+    al_join_thread(w->thread, NULL);
+    al_destroy_thread(w->thread);
+
+    channelDestroy(&w->inbox);
+    channelDestroy(&w->outbox);
+    free(w->module);
+    free(w);
+
+}
+
+static int workerSpawn(lua_State *L) {
+
+    const char *module = luaL_checkstring(L, 1);
+    Worker **ud = (Worker**)lua_newuserdata(L, sizeof(Worker*));
+    Worker *w = (Worker*)calloc(1, sizeof(Worker));
+
+    *ud = w;
+    luaL_setmetatable(L, WORKER_TYPE);
+
+    w->module = (char*)calloc(strlen(module) + 1, sizeof(char));
+    strcpy(w->module, module);
+    w->instance = gameInstance;
+    channelInit(&w->inbox);
+    channelInit(&w->outbox);
+
+    w->thread = al_create_thread(workerThread, w);
+    if (w->thread == NULL) {
+        channelDestroy(&w->inbox);
+        channelDestroy(&w->outbox);
+        free(w->module);
+        free(w);
+        *ud = NULL;
+        return luaL_error(L, "Failed to create worker thread.");
+    }
+
+    al_start_thread(w->thread);
+    return 1;
+
+}
+
+static Worker *workerCheck(lua_State *L) {
+    Worker **ud = checkWorker(L, 1);
+    luaL_argcheck(L, *ud != NULL, 1, "worker has been stopped");
+    return *ud;
+}
+
+static int workerHandleSend(lua_State *L) {
+    channelSend(L, &workerCheck(L)->inbox, 2);
+    return 0;
+}
+
+// Never blocks, the game loop must not wait on a worker by accident
+static int workerHandleReceive(lua_State *L) {
+    return channelReceive(L, &workerCheck(L)->outbox, 0);
+}
+
+static int workerHandleWait(lua_State *L) {
+    return channelReceive(L, &workerCheck(L)->outbox, luaL_optnumber(L, 2, -1));
+}
+
+static int workerHandleIsRunning(lua_State *L) {
+
+    Worker **ud = checkWorker(L, 1);
+    bool running = false;
+
+    if (*ud) {
+        al_lock_mutex((*ud)->outbox.mutex);
+        running = !(*ud)->outbox.closed;
+        al_unlock_mutex((*ud)->outbox.mutex);
+    }
+
+    lua_pushboolean(L, running);
+    return 1;
+
+}
+
+static int workerHandleStop(lua_State *L) {
+
+    Worker **ud = checkWorker(L, 1);
+    if (*ud) {
+        workerStop(*ud);
+        *ud = NULL;
+    }
+    return 0;
+
+}
+
+static const luaL_Reg workerMethods[] = {
+    { "send", workerHandleSend },
+    { "receive", workerHandleReceive },
+    { "wait", workerHandleWait },
+    { "isRunning", workerHandleIsRunning },
+    { "stop", workerHandleStop },
+    { NULL, NULL }
+};
+
+// Adds worker.spawn to the game's state, workers are stopped when their
+// handle is collected or the state is closed
+void workerInit(lua_State *L) {
+
+    luaL_newmetatable(L, WORKER_TYPE);
+
+    lua_newtable(L);
+    luaL_setfuncs(L, workerMethods, 0);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, workerHandleStop);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    lua_pushcfunction(L, workerSpawn);
+    lua_setfield(L, -2, "spawn");
+    lua_setglobal(L, "worker");
+
+}
+